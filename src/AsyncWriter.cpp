@@ -0,0 +1,100 @@
+#include "AsyncWriter.h"
+
+using namespace std;
+
+
+AsyncFileWriter::AsyncFileWriter(const string& filename, size_t bufferSize, size_t bufferCount)
+	: outFile(filename, std::ios::binary | std::ios::trunc), bufferSize(bufferSize)
+{
+	bOpen = outFile.is_open();
+	if (!bOpen)
+		return;
+
+	// the buffers are allocated once and recycled between the formatter and the writer thread
+	current.reserve(bufferSize);
+	for (size_t i = 1; i < bufferCount; ++i)
+	{
+		freeBuffers.emplace_back();
+		freeBuffers.back().reserve(bufferSize);
+	}
+
+	writer = thread(&AsyncFileWriter::writerLoop, this);
+}
+
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+	close();
+}
+
+
+void AsyncFileWriter::submit()
+{
+	if (!bOpen || current.empty())
+		return;
+
+	unique_lock<mutex> guard(lock);
+	fullBuffers.push_back(std::move(current));
+	fullReady.notify_one();
+
+	// back pressure: wait for the writer thread to return a buffer
+	freeReady.wait(guard, [this] { return !freeBuffers.empty(); });
+	current = std::move(freeBuffers.front());
+	freeBuffers.pop_front();
+	current.clear();
+}
+
+
+void AsyncFileWriter::writerLoop()
+{
+	for (;;)
+	{
+		vector<char> buffer;
+		{
+			unique_lock<mutex> guard(lock);
+			fullReady.wait(guard, [this] { return bDone || !fullBuffers.empty(); });
+
+			if (fullBuffers.empty())
+				return;
+
+			buffer = std::move(fullBuffers.front());
+			fullBuffers.pop_front();
+		}
+
+		outFile.write(buffer.data(), buffer.size());
+
+		{
+			lock_guard<mutex> guard(lock);
+			bFailed |= !outFile;
+			freeBuffers.push_back(std::move(buffer));
+		}
+		freeReady.notify_one();
+	}
+}
+
+
+bool AsyncFileWriter::close()
+{
+	if (!bOpen)
+		return !bFailed;
+
+	if (!current.empty())
+	{
+		lock_guard<mutex> guard(lock);
+		fullBuffers.push_back(std::move(current));
+	}
+
+	{
+		lock_guard<mutex> guard(lock);
+		bDone = true;
+	}
+	fullReady.notify_one();
+
+	if (writer.joinable())
+		writer.join();
+
+	outFile.close();
+	bOpen = false;
+
+	return !bFailed && !outFile.fail();
+}
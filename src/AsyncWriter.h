@@ -0,0 +1,75 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <charconv>
+
+// Buffered file writer that formats into large reusable buffers and hands full buffers to a background
+// thread, so formatting overlaps with the disk writes. Numbers are formatted with std::to_chars.
+class AsyncFileWriter
+{
+public:
+	explicit AsyncFileWriter(const std::string& filename, size_t bufferSize = 1 << 20, size_t bufferCount = 4);
+	~AsyncFileWriter();
+
+	AsyncFileWriter(const AsyncFileWriter&) = delete;
+	AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+	bool is_open() const { return bOpen; }
+
+	void write(std::string_view text)
+	{
+		if (current.size() + text.size() > bufferSize) submit();
+
+		if (text.size() > bufferSize)
+		{
+			// oversized payloads bypass the buffer but keep their position in the stream
+			current.assign(text.begin(), text.end());
+			submit();
+			return;
+		}
+
+		current.insert(current.end(), text.begin(), text.end());
+	}
+
+	void write(char c)
+	{
+		if (current.size() + 1 > bufferSize) submit();
+		current.push_back(c);
+	}
+
+	template <typename T>
+	void writeNumber(T value)
+	{
+		char buf[32];
+		auto [ptr, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+		if (ec == std::errc()) write(std::string_view(buf, ptr - buf));
+	}
+
+	// flush everything queued so far and wait for the writer thread to finish
+	bool close();
+
+private:
+	void submit();
+	void writerLoop();
+
+	std::ofstream outFile;
+	size_t bufferSize;
+	bool bOpen = false;
+	bool bFailed = false;
+	bool bDone = false;
+
+	std::vector<char> current;
+	std::deque<std::vector<char>> fullBuffers;
+	std::deque<std::vector<char>> freeBuffers;
+
+	std::mutex lock;
+	std::condition_variable fullReady;
+	std::condition_variable freeReady;
+	std::thread writer;
+};
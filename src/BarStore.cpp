@@ -0,0 +1,245 @@
+#include <fstream>
+#include <algorithm>
+#include <mutex>
+
+#include "BarStore.h"
+#include "CsvBars.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+void _BAR_SERIES::reserve(size_t n)
+{
+	timestamp.reserve(n);
+	open.reserve(n);
+	high.reserve(n);
+	low.reserve(n);
+	close.reserve(n);
+	volume.reserve(n);
+}
+
+
+void _BAR_SERIES::push_back(const _BAR& bar)
+{
+	timestamp.push_back(bar.timestamp);
+	open.push_back(bar.open);
+	high.push_back(bar.high);
+	low.push_back(bar.low);
+	close.push_back(bar.close);
+	volume.push_back(bar.volume);
+}
+
+
+size_t _BAR_SERIES::lowerBound(long long epoch) const
+{
+	return std::lower_bound(timestamp.begin(), timestamp.end(), epoch) - timestamp.begin();
+}
+
+
+void BarStore::append(const string& symbol, const BarVector& bars)
+{
+	if (bars.empty())
+		return;
+
+	BarVector sorted(bars);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const _BAR& a, const _BAR& b) { return a.timestamp < b.timestamp; });
+
+	unique_lock<shared_mutex> guard(lock);
+	_BAR_SERIES& series = bySymbol[symbol];
+
+	// the common case, new bars after everything already stored
+	if (series.empty() || series.timestamp.back() < sorted.front().timestamp)
+	{
+		series.reserve(series.size() + sorted.size());
+		for (size_t i = 0; i < sorted.size(); ++i)
+		{
+			if (i + 1 < sorted.size() && sorted[i + 1].timestamp == sorted[i].timestamp)
+				continue;		// a later duplicate wins
+			series.push_back(sorted[i]);
+		}
+	}
+	else
+	{
+		// overlapping range, merge both sides into a new series; on equal timestamps the new bar wins
+		_BAR_SERIES merged;
+		merged.reserve(series.size() + sorted.size());
+
+		size_t i = 0, j = 0;
+		while (i < series.size() || j < sorted.size())
+		{
+			if (j + 1 < sorted.size() && sorted[j + 1].timestamp == sorted[j].timestamp)
+			{
+				++j;
+				continue;
+			}
+
+			if (j == sorted.size() || (i < series.size() && series.timestamp[i] < sorted[j].timestamp))
+			{
+				merged.push_back(series.at(i++));
+			}
+			else
+			{
+				if (i < series.size() && series.timestamp[i] == sorted[j].timestamp)
+					++i;
+				merged.push_back(sorted[j++]);
+			}
+		}
+
+		series = std::move(merged);
+	}
+
+	changes.fetch_add(1, memory_order_release);
+}
+
+
+bool BarStore::loadPartitions(const string& basePath)
+{
+	std::error_code ec;
+	const fs::path dailyRoot = fs::path(basePath) / "Daily";
+	if (!fs::exists(dailyRoot, ec))
+	{
+		LOG_WARNING << "No Daily partitions under " << basePath;
+		return false;
+	}
+
+	// <SYM>_<yyyy-mm-dd>.csv grouped by symbol and in date order, as loadFiles() wants them; month folders
+	// are not zero padded, so the order comes from the date in the name rather than from the path
+	map<string, vector<pair<string, fs::path>>> bySymbolFiles;
+	for (fs::recursive_directory_iterator itr(dailyRoot, ec), end; !ec && itr != end; itr.increment(ec))
+	{
+		if (!itr->is_regular_file(ec) || itr->path().extension() != ".csv")
+			continue;
+
+		string symbol, date;
+		if (!splitPartitionStem(itr->path().stem().string(), symbol, date))
+			continue;
+
+		bySymbolFiles[symbol].emplace_back(date, itr->path());
+	}
+
+	BarFileVector files;
+	for (auto& entry : bySymbolFiles)
+	{
+		std::sort(entry.second.begin(), entry.second.end());
+		for (const auto& dated : entry.second)
+			files.push_back(_BAR_FILE{ entry.first, dated.second });
+	}
+
+	bool lOK = loadFiles(files);
+
+	LOG_INFO << "Loaded " << rows() << " bar(s) for " << bySymbolFiles.size() << " symbol(s) from " << dailyRoot.string();
+	return lOK;
+}
+
+
+// rows of one partition in [from, to)
+static bool readBarFile(const _BAR_FILE& file, BarVector& bars, size_t& rejected)
+{
+	return readPartitionFile(file.filename, [&](const _BAR& bar)
+	{
+		if (bar.timestamp >= file.from && bar.timestamp < file.to)
+			bars.push_back(bar);
+	}, &rejected);
+}
+
+
+bool BarStore::loadFiles(const BarFileVector& files)
+{
+	// one task per file; all files of a symbol are queued on the same worker, which reads them back to
+	// back unless idle workers steal some, and whichever task finishes the symbol's last file merges the
+	// symbol into the store while its rows are still in that core's cache
+	struct _SYMBOL_LOAD
+	{
+		size_t first;
+		size_t last;
+		atomic<size_t> remaining;
+	};
+
+	size_t symbolCount = 0;
+	for (size_t i = 0; i < files.size(); ++i)
+		symbolCount += (i == 0 || files[i].symbol != files[i - 1].symbol) ? 1 : 0;
+
+	vector<BarVector> results(files.size());
+	vector<_SYMBOL_LOAD> symbols(symbolCount);
+
+	atomic<size_t> rejected{ 0 };
+	atomic<bool> failed{ false };
+
+	TaskGroup group;
+	for (size_t i = 0, k = 0; i < files.size(); ++k)
+	{
+		size_t last = i + 1;
+		while (last < files.size() && files[last].symbol == files[i].symbol)
+			++last;
+
+		_SYMBOL_LOAD& load = symbols[k];
+		load.first = i;
+		load.last = last;
+		load.remaining.store(last - i, memory_order_relaxed);
+
+		for (; i < last; ++i)
+		{
+			group.run([&, i, k]()
+			{
+				size_t fileRejected = 0;
+				if (!readBarFile(files[i], results[i], fileRejected))
+					failed.store(true, memory_order_relaxed);
+				rejected.fetch_add(fileRejected, memory_order_relaxed);
+
+				_SYMBOL_LOAD& symbol = symbols[k];
+				if (symbol.remaining.fetch_sub(1, memory_order_acq_rel) != 1)
+					return;
+
+				// files are in date order, so the concatenation is sorted and append() takes its fast path
+				BarVector bars = std::move(results[symbol.first]);
+				for (size_t f = symbol.first + 1; f < symbol.last; ++f)
+				{
+					bars.insert(bars.end(), results[f].begin(), results[f].end());
+					BarVector().swap(results[f]);
+				}
+
+				append(files[symbol.first].symbol, bars);
+			}, k);
+		}
+	}
+	group.wait();
+
+	if (rejected > 0)
+		LOG_WARNING << "Skipped " << rejected.load() << " malformed row(s) in the partitions";
+
+	return !failed.load();
+}
+
+
+vector<string> BarStore::symbols() const
+{
+	shared_lock<shared_mutex> guard(lock);
+
+	vector<string> names;
+	names.reserve(bySymbol.size());
+	for (const auto& entry : bySymbol)
+		names.push_back(entry.first);
+
+	return names;
+}
+
+
+size_t BarStore::rows() const
+{
+	shared_lock<shared_mutex> guard(lock);
+
+	size_t total = 0;
+	for (const auto& entry : bySymbol)
+		total += entry.second.size();
+
+	return total;
+}
+
+
+const _BAR_SERIES* BarStore::find(const string& symbol) const
+{
+	auto itr = bySymbol.find(symbol);
+	return itr == bySymbol.end() ? nullptr : &itr->second;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <shared_mutex>
+#include <atomic>
+#include <climits>
+#include <filesystem>
+
+#include "Stock.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Columnar bar store: one _BAR_SERIES per symbol with every OHLCV field in its own contiguous vector,
+// sorted by timestamp without duplicates. Scans that only touch a couple of fields (resampling, range
+// sums, indicators) stream through dense arrays instead of striding over whole _BAR rows.
+//
+// Series are appended under a writer lock; readers take the shared lock for as long as they hold spans
+// into a series. version() changes with every append so derived results can be cached against it.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+struct _BAR_SERIES
+{
+	std::vector<long long> timestamp;		// UTC epoch seconds, ascending
+	std::vector<double> open;
+	std::vector<double> high;
+	std::vector<double> low;
+	std::vector<double> close;
+	std::vector<long long> volume;
+
+	size_t size() const { return timestamp.size(); }
+	bool empty() const { return timestamp.empty(); }
+
+	void reserve(size_t n);
+	void push_back(const _BAR& bar);
+	_BAR at(size_t i) const { return _BAR{ timestamp[i], open[i], high[i], low[i], close[i], volume[i] }; }
+
+	// first row at or after <epoch>
+	size_t lowerBound(long long epoch) const;
+};
+
+using BarSeriesMap = std::map<std::string, _BAR_SERIES>;
+
+// a partition to load and the rows of it wanted, UTC epoch seconds
+struct _BAR_FILE
+{
+	std::string symbol;
+	std::filesystem::path filename;
+	long long from = LLONG_MIN;
+	long long to = LLONG_MAX;
+};
+
+using BarFileVector = std::vector<_BAR_FILE>;
+
+class BarStore
+{
+public:
+	BarStore() = default;
+
+	BarStore(const BarStore&) = delete;
+	BarStore& operator=(const BarStore&) = delete;
+
+	// merges <bars> into the symbol's series, a bar with an existing timestamp replaces it
+	void append(const std::string& symbol, const BarVector& bars);
+
+	// reads every Daily/<y>/<m>/<date>/<SYM>_<date>.csv partition under <basePath>
+	bool loadPartitions(const std::string& basePath);
+
+	// reads <files> in parallel on the shared thread pool (see ThreadPool.h); the files of a symbol are
+	// consecutive and in time order
+	bool loadFiles(const BarFileVector& files);
+
+	std::vector<std::string> symbols() const;
+	size_t rows() const;
+	uint64_t version() const { return changes.load(std::memory_order_acquire); }
+
+	// callers hold lockShared() while they use the returned series
+	const _BAR_SERIES* find(const std::string& symbol) const;
+	const BarSeriesMap& series() const { return bySymbol; }
+
+	std::shared_lock<std::shared_mutex> lockShared() const { return std::shared_lock<std::shared_mutex>(lock); }
+
+private:
+	mutable std::shared_mutex lock;
+	BarSeriesMap bySymbol;
+	std::atomic<uint64_t> changes{ 0 };
+};
@@ -0,0 +1,266 @@
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+
+#include "BatchWriter.h"
+#include "Log.h"
+
+#if defined(__linux__) && __has_include(<liburing.h>)
+#define TICKERTAPE_IO_URING 1
+#include <liburing.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#else
+#define TICKERTAPE_IO_URING 0
+#endif
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+struct _URING_STATE
+{
+#if TICKERTAPE_IO_URING
+	struct io_uring ring;
+#endif
+};
+
+
+BatchFileWriter::BatchFileWriter(size_t queueDepth)
+	: queueDepth(std::max<size_t>(queueDepth, 1))
+{
+#if TICKERTAPE_IO_URING
+	uring = make_unique<_URING_STATE>();
+
+	struct io_uring_params params = {};
+	if (io_uring_queue_init_params(static_cast<unsigned>(this->queueDepth), &uring->ring, &params) < 0)
+	{
+		uring.reset();
+	}
+	else if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+	{
+		// writes rely on "current file position" offsets, older kernels take the synchronous path
+		io_uring_queue_exit(&uring->ring);
+		uring.reset();
+	}
+#endif
+}
+
+
+BatchFileWriter::~BatchFileWriter()
+{
+	flush();
+
+#if TICKERTAPE_IO_URING
+	if (uring)
+		io_uring_queue_exit(&uring->ring);
+#endif
+}
+
+
+void BatchFileWriter::queue
+(
+	const string& filename,
+	shared_ptr<const string> data,
+	bool bAppend,
+	shared_ptr<const string> header
+)
+{
+	auto itr = index.find(filename);
+
+	if (itr == index.end())
+	{
+		std::error_code ec;
+		bool bNewFile = !bAppend || !fs::exists(filename, ec);
+
+		_FILE_WRITE fileWrite{ filename, bAppend, {} };
+		if (header && bNewFile)
+			fileWrite.chunks.push_back(header);
+
+		itr = index.emplace(filename, writes.size()).first;
+		writes.push_back(std::move(fileWrite));
+	}
+	else if (!bAppend)
+	{
+		// a later overwrite replaces whatever was queued for the file
+		_FILE_WRITE& fileWrite = writes[itr->second];
+		fileWrite.bAppend = false;
+		fileWrite.chunks.clear();
+		if (header)
+			fileWrite.chunks.push_back(header);
+	}
+
+	writes[itr->second].chunks.push_back(std::move(data));
+}
+
+
+bool BatchFileWriter::flush()
+{
+	if (writes.empty())
+		return true;
+
+	bool lOK = uring ? flushIoUring() : flushSync();
+
+	writes.clear();
+	index.clear();
+
+	return lOK;
+}
+
+
+static bool writeFileSync(const _FILE_WRITE& fileWrite)
+{
+	ofstream outFile(fileWrite.filename, std::ios::binary | (fileWrite.bAppend ? std::ios::app : std::ios::trunc));
+	if (!outFile)
+	{
+		LOG_ERROR << "Cannot open " << fileWrite.filename;
+		return false;
+	}
+
+	for (const auto& chunk : fileWrite.chunks)
+		outFile.write(chunk->data(), chunk->size());
+
+	return static_cast<bool>(outFile);
+}
+
+
+bool BatchFileWriter::flushSync()
+{
+	bool lOK = true;
+
+	for (const auto& fileWrite : writes)
+		lOK &= writeFileSync(fileWrite);
+
+	return lOK;
+}
+
+
+#if TICKERTAPE_IO_URING
+
+// submit everything prepared so far and reap exactly <count> completions
+static void submitAndReap(struct io_uring& ring, size_t count, const function<void(size_t, int)>& onComplete)
+{
+	io_uring_submit_and_wait(&ring, static_cast<unsigned>(count));
+
+	for (size_t n = 0; n < count; ++n)
+	{
+		struct io_uring_cqe* cqe = nullptr;
+		if (io_uring_wait_cqe(&ring, &cqe) < 0)
+			break;
+
+		onComplete(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)), cqe->res);
+		io_uring_cqe_seen(&ring, cqe);
+	}
+}
+
+
+// finish a short or failed vectored write on the still open descriptor
+static bool writeRemaining(int fd, const _FILE_WRITE& fileWrite, size_t written)
+{
+	for (const auto& chunk : fileWrite.chunks)
+	{
+		if (written >= chunk->size())
+		{
+			written -= chunk->size();
+			continue;
+		}
+
+		const char* p = chunk->data() + written;
+		size_t remaining = chunk->size() - written;
+		written = 0;
+
+		while (remaining > 0)
+		{
+			ssize_t n = ::write(fd, p, remaining);
+			if (n <= 0)
+				return false;
+
+			p += n;
+			remaining -= static_cast<size_t>(n);
+		}
+	}
+
+	return true;
+}
+
+
+// Each window of up to queueDepth files goes through three submission rounds: all opens, all writes, all
+// closes. Every round is one io_uring_enter() with the whole window in flight.
+bool BatchFileWriter::flushIoUring()
+{
+	struct io_uring& ring = uring->ring;
+	bool lOK = true;
+
+	for (size_t base = 0; base < writes.size(); base += queueDepth)
+	{
+		const size_t count = std::min(queueDepth, writes.size() - base);
+		vector<int> fds(count, -1);
+		vector<vector<struct iovec>> iovecs(count);
+		size_t submitted = 0;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const _FILE_WRITE& fileWrite = writes[base + i];
+			int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (fileWrite.bAppend ? O_APPEND : O_TRUNC);
+
+			struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_openat(sqe, AT_FDCWD, fileWrite.filename.c_str(), flags, 0644);
+			io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+		}
+		submitAndReap(ring, count, [&](size_t i, int res) { fds[i] = res; });
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (fds[i] < 0)
+			{
+				// could not open through the ring, try the synchronous path for this file
+				lOK &= writeFileSync(writes[base + i]);
+				continue;
+			}
+
+			for (const auto& chunk : writes[base + i].chunks)
+				iovecs[i].push_back({ const_cast<char*>(chunk->data()), chunk->size() });
+
+			struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_writev(sqe, fds[i], iovecs[i].data(), static_cast<unsigned>(iovecs[i].size()), static_cast<__u64>(-1));
+			io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+			++submitted;
+		}
+		submitAndReap(ring, submitted, [&](size_t i, int res)
+		{
+			size_t total = 0;
+			for (const auto& v : iovecs[i])
+				total += v.iov_len;
+
+			if (res < 0 || static_cast<size_t>(res) < total)
+				lOK &= writeRemaining(fds[i], writes[base + i], res < 0 ? 0 : static_cast<size_t>(res));
+		});
+
+		submitted = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (fds[i] < 0)
+				continue;
+
+			struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_close(sqe, fds[i]);
+			io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+			++submitted;
+		}
+		submitAndReap(ring, submitted, [&](size_t, int res) { lOK &= res >= 0; });
+	}
+
+	return lOK;
+}
+
+#else
+
+bool BatchFileWriter::flushIoUring()
+{
+	return flushSync();
+}
+
+#endif
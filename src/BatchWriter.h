@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+// One small file in a batch. Several queued writes to the same file are merged into one entry so they
+// stay ordered, their payloads are shared rather than copied.
+struct _FILE_WRITE
+{
+	std::string filename;
+	bool bAppend;
+	std::vector<std::shared_ptr<const std::string>> chunks;
+};
+
+struct _URING_STATE;
+
+// Collects many small file writes and issues them together. On Linux with liburing available the opens,
+// writes and closes of a batch are submitted through io_uring submission queues and kept in flight
+// together; everywhere else, or when the ring cannot be created, each file is written synchronously.
+class BatchFileWriter
+{
+public:
+	explicit BatchFileWriter(size_t queueDepth = 256);
+	~BatchFileWriter();
+
+	BatchFileWriter(const BatchFileWriter&) = delete;
+	BatchFileWriter& operator=(const BatchFileWriter&) = delete;
+
+	bool usingIoUring() const { return uring != nullptr; }
+
+	// header is written first when the file does not exist yet (or is truncated)
+	void queue
+	(
+		const std::string& filename,
+		std::shared_ptr<const std::string> data,
+		bool bAppend,
+		std::shared_ptr<const std::string> header = nullptr
+	);
+
+	// writes every queued file, returns false when any of them failed
+	bool flush();
+
+	size_t pending() const { return writes.size(); }
+
+private:
+	bool flushSync();
+	bool flushIoUring();
+
+	size_t queueDepth;
+	std::vector<_FILE_WRITE> writes;
+	std::map<std::string, size_t> index;
+	std::unique_ptr<_URING_STATE> uring;
+};
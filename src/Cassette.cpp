@@ -0,0 +1,230 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "Cassette.h"
+#include "Log.h"
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Cassette layout:
+//
+//   <folder>/cassette.idx         one line per response: <key> <http code> <url>, later lines win
+//   <folder>/<key>.body           the response body exactly as received
+//
+// <key> is the 64 bit FNV-1a hash of the URL in hex.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+static const char* IndexFilename = "cassette.idx";
+
+
+static bool mapFile(const string& filename, _MAPPED_FILE& file)
+{
+	file = _MAPPED_FILE();
+
+	std::error_code ec;
+	auto size = fs::file_size(filename, ec);
+	if (ec)
+		return false;
+
+	// an empty body has nothing to map
+	if (size == 0)
+		return true;
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(hFile);
+	if (!hMapping)
+		return false;
+
+	const void* view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(hMapping);
+		return false;
+	}
+
+	file.mapping = hMapping;
+	file.data = static_cast<const char*>(view);
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+
+	file.data = static_cast<const char*>(view);
+#endif
+
+	file.size = static_cast<size_t>(size);
+	return true;
+}
+
+
+static void unmapFile(_MAPPED_FILE& file)
+{
+	if (!file.data)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(file.data);
+	CloseHandle(file.mapping);
+#else
+	munmap(const_cast<char*>(file.data), file.size);
+#endif
+
+	file = _MAPPED_FILE();
+}
+
+
+Cassette::~Cassette()
+{
+	for (auto& entry : entries)
+		unmapFile(entry.second.file);
+}
+
+
+string Cassette::keyOf(const string& url)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned char c : url)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+
+	char buf[24];
+	snprintf(buf, sizeof(buf), "%016llx", hash);
+	return string(buf);
+}
+
+
+bool Cassette::configure(const _CASSETTE_OPTIONS& newOptions)
+{
+	lock_guard<mutex> guard(lock);
+
+	for (auto& entry : entries)
+		unmapFile(entry.second.file);
+	entries.clear();
+
+	options = newOptions;
+	random.seed(options.seed);
+
+	if (options.mode == CassetteMode::Off)
+		return true;
+
+	std::error_code ec;
+	fs::create_directories(options.folder, ec);
+
+	return loadIndex();
+}
+
+
+bool Cassette::loadIndex()
+{
+	ifstream index(fs::path(options.folder) / IndexFilename);
+	if (!index)
+		return !replaying();
+
+	string txtLine;
+	while (getline(index, txtLine))
+	{
+		string key;
+		long httpCode = 0;
+		stringstream ss(txtLine);
+
+		if (!(ss >> key >> httpCode))
+			continue;
+
+		entries[key] = _ENTRY{ httpCode, (fs::path(options.folder) / (key + ".body")).string(), _MAPPED_FILE() };
+	}
+
+	LOG_INFO << "Cassette " << options.folder << ": " << entries.size() << " recorded response(s)";
+	return true;
+}
+
+
+void Cassette::record(const string& url, long httpCode, const string& body)
+{
+	if (!recording())
+		return;
+
+	const string key = keyOf(url);
+	const fs::path bodyFilename = fs::path(options.folder) / (key + ".body");
+
+	lock_guard<mutex> guard(lock);
+
+	ofstream bodyFile(bodyFilename, std::ios::binary | std::ios::trunc);
+	bodyFile.write(body.data(), body.size());
+
+	ofstream index(fs::path(options.folder) / IndexFilename, std::ios::app);
+	index << key << ' ' << httpCode << ' ' << url << '\n';
+
+	entries[key] = _ENTRY{ httpCode, bodyFilename.string(), _MAPPED_FILE() };
+}
+
+
+bool Cassette::replay(const string& url, long& httpCode, string& body)
+{
+	if (!replaying())
+		return false;
+
+	body.clear();
+
+	lock_guard<mutex> guard(lock);
+
+	// injected failures answer before the recording is looked at, as a throttling server would
+	if (options.errorRate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < options.errorRate)
+	{
+		httpCode = options.errorCode;
+		return true;
+	}
+
+	auto itr = entries.find(keyOf(url));
+	if (itr == entries.end())
+	{
+		LOG_ERROR << "Cassette has no recording for " << url;
+		httpCode = 404;
+		return true;
+	}
+
+	_ENTRY& entry = itr->second;
+	if (!entry.file.data && !mapFile(entry.filename, entry.file))
+	{
+		LOG_ERROR << "Cannot map " << entry.filename;
+		httpCode = 404;
+		return true;
+	}
+
+	httpCode = entry.httpCode;
+	body.assign(entry.file.data, entry.file.size);
+	return true;
+}
+
+
+Cassette& getCassette()
+{
+	static Cassette cassette;
+	return cassette;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <map>
+#include <mutex>
+#include <random>
+#include <chrono>
+
+#include "Stock.h"
+
+struct _CASSETTE_OPTIONS
+{
+	CassetteMode mode = CassetteMode::Off;
+	std::string folder;
+	std::chrono::milliseconds latency{ 0 };		// added to every replayed response
+	double errorRate = 0.0;						// fraction of replayed requests answered with errorCode
+	long errorCode = 429;
+	unsigned seed = 1;							// fixed seed keeps injected errors reproducible
+};
+
+// Read-only view of a recorded response body, mapped into memory once and kept for the whole run.
+struct _MAPPED_FILE
+{
+	const char* data = nullptr;
+	size_t size = 0;
+	void* mapping = nullptr;
+};
+
+// HTTP record/replay layer below fetch_with_backoff() and DownloadEngine. In Record mode every response is
+// stored in <folder> keyed by a hash of its URL; in Replay mode responses are served from those files
+// through memory mapping, with optional injected latency and error codes, and the network is never used.
+class Cassette
+{
+public:
+	~Cassette();
+
+	bool configure(const _CASSETTE_OPTIONS& options);
+
+	bool recording() const { return options.mode == CassetteMode::Record; }
+	bool replaying() const { return options.mode == CassetteMode::Replay; }
+	std::chrono::milliseconds latency() const { return options.latency; }
+
+	void record(const std::string& url, long httpCode, const std::string& body);
+
+	// fills httpCode and body, unknown URLs answer 404; does not apply the latency
+	bool replay(const std::string& url, long& httpCode, std::string& body);
+
+private:
+	struct _ENTRY
+	{
+		long httpCode;
+		std::string filename;
+		_MAPPED_FILE file;
+	};
+
+	static std::string keyOf(const std::string& url);
+	bool loadIndex();
+
+	_CASSETTE_OPTIONS options;
+	std::mutex lock;
+	std::map<std::string, _ENTRY> entries;
+	std::mt19937 random;
+};
+
+Cassette& getCassette();
@@ -0,0 +1,373 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "ChartServer.h"
+#include "Download.h"
+#include "Log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+static const string ChartPath = "/v8/finance/chart/";
+
+// longest range answered at once, a month of minutes
+constexpr long long MaxChartBars = 60 * 24 * 31;
+
+
+static unsigned long long symbolSeed(const string& symbol)
+{
+	// FNV-1a, stable across runs and platforms
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned char c : symbol)
+		hash = (hash ^ c) * 1099511628211ull;
+	return hash;
+}
+
+
+// value of <name>=<value> in the query of <target>, or <fallback>
+static long long queryValue(const string& target, const string& name, long long fallback)
+{
+	size_t query = target.find('?');
+	for (size_t pos = query; pos != string::npos && pos + 1 < target.size(); pos = target.find('&', pos + 1))
+	{
+		const size_t equals = pos + 1 + name.size();
+		if (equals < target.size() && target.compare(pos + 1, name.size(), name) == 0 && target[equals] == '=')
+			return strtoll(target.c_str() + pos + 2 + name.size(), nullptr, 10);
+	}
+	return fallback;
+}
+
+
+// symbols may arrive %-encoded, e.g. %5EIXIC
+static string decodeSymbol(const string& text)
+{
+	string symbol;
+	for (size_t i = 0; i < text.size(); ++i)
+	{
+		if (text[i] == '%' && i + 2 < text.size())
+		{
+			symbol.push_back(static_cast<char>(strtol(text.substr(i + 1, 2).c_str(), nullptr, 16)));
+			i += 2;
+		}
+		else
+		{
+			symbol.push_back(text[i]);
+		}
+	}
+	return symbol;
+}
+
+
+string ChartServer::chartBody(const string& symbol, long long period1, long long period2)
+{
+	const unsigned long long seed = symbolSeed(symbol);
+	const double base = 20.0 + static_cast<double>(seed % 480);
+
+	string timestamps, opens, highs, lows, closes, volumes;
+	char number[32];
+
+	auto add = [&number](string& list, const char* format, auto value)
+	{
+		int n = snprintf(number, sizeof(number), format, value);
+		if (!list.empty())
+			list.push_back(',');
+		list.append(number, static_cast<size_t>(std::max(n, 0)));
+	};
+
+	// one bar per minute, prices in cents so the client can compare the text exactly
+	long long first = period1 + (60 - period1 % 60) % 60;
+	long long last = std::min(period2, first + MaxChartBars * 60);
+
+	for (long long t = first; t < last; t += 60)
+	{
+		const unsigned long long minute = static_cast<unsigned long long>(t / 60) + seed;
+		const double open = base + static_cast<double>(minute % 200) / 100.0;
+		const double close = base + static_cast<double>((minute * 7) % 200) / 100.0;
+
+		add(timestamps, "%lld", t);
+		add(opens, "%.2f", open);
+		add(highs, "%.2f", std::max(open, close) + 0.05);
+		add(lows, "%.2f", std::min(open, close) - 0.05);
+		add(closes, "%.2f", close);
+		add(volumes, "%llu", 100 * (1 + (minute >> 3) % 50));
+	}
+
+	return "{\"chart\":{\"result\":[{\"meta\":{\"symbol\":\"" + symbol + "\",\"dataGranularity\":\"1m\"},"
+		"\"timestamp\":[" + timestamps + "],"
+		"\"indicators\":{\"quote\":[{\"open\":[" + opens + "],\"high\":[" + highs + "],\"low\":[" + lows
+		+ "],\"close\":[" + closes + "],\"volume\":[" + volumes + "]}]}}],\"error\":null}}";
+}
+
+
+bool ChartServer::listen(const _STREAM_ENDPOINT& endpoint)
+{
+	if (endpoint.kind != _STREAM_ENDPOINT::Kind::Tcp)
+	{
+		LOG_ERROR << "The chart stand-in serves HTTP over tcp://host:port only, not " << endpoint.describe();
+		return false;
+	}
+
+	listener = StreamListener::listen(endpoint);
+	if (!listener)
+	{
+		LOG_ERROR << "Cannot listen on " << endpoint.describe();
+		return false;
+	}
+
+	this->endpoint = endpoint;
+	bStopping = false;
+
+	LOG_INFO << "Serving Yahoo charts on http://" << endpoint.host << ":" << endpoint.port;
+	return true;
+}
+
+
+bool ChartServer::start(const _STREAM_ENDPOINT& endpoint)
+{
+	if (!listen(endpoint))
+		return false;
+
+	acceptor = thread(&ChartServer::run, this);
+	return true;
+}
+
+
+void ChartServer::run()
+{
+	while (!bStopping)
+	{
+		auto accepted = listener->accept();
+		if (!accepted || bStopping)
+			break;
+
+		lock_guard<mutex> guard(lock);
+
+		// a long running server sees many short lived clients
+		for (auto itr = sessions.begin(); itr != sessions.end();)
+		{
+			if ((*itr)->bFinished)
+			{
+				(*itr)->server.join();
+				itr = sessions.erase(itr);
+			}
+			else
+			{
+				++itr;
+			}
+		}
+
+		sessions.push_back(make_unique<_SESSION>());
+		_SESSION* session = sessions.back().get();
+		session->connection = shared_ptr<StreamConnection>(std::move(accepted));
+		session->server = thread([this, session]()
+		{
+			serve(*session->connection);
+			session->bFinished = true;
+		});
+	}
+}
+
+
+void ChartServer::stop()
+{
+	bStopping = true;
+
+	// a connection of our own wakes the blocked accept()
+	if (acceptor.joinable())
+	{
+		StreamConnection::connect(endpoint);
+		acceptor.join();
+	}
+
+	vector<unique_ptr<_SESSION>> finished;
+	{
+		lock_guard<mutex> guard(lock);
+		for (auto& session : sessions)
+			session->connection->shutdown();
+		finished.swap(sessions);
+	}
+
+	for (auto& session : finished)
+		session->server.join();
+
+	listener.reset();
+}
+
+
+// reads requests off a kept alive connection until the client closes it
+void ChartServer::serve(StreamConnection& connection)
+{
+	string received;
+	vector<char> buffer(16 * 1024);
+
+	for (;;)
+	{
+		size_t end = received.find("\r\n\r\n");
+		if (end == string::npos)
+		{
+			long long n = connection.read(buffer.data(), buffer.size());
+			if (n <= 0)
+				return;
+
+			received.append(buffer.data(), static_cast<size_t>(n));
+			continue;
+		}
+
+		// GET <target> HTTP/1.1, the headers are not needed
+		string requestLine = received.substr(0, received.find("\r\n"));
+		received.erase(0, end + 4);
+
+		size_t space = requestLine.find(' ');
+		size_t space2 = requestLine.find(' ', space + 1);
+		string target = space == string::npos ? string() : requestLine.substr(space + 1, space2 == string::npos ? string::npos : space2 - space - 1);
+
+		if (requestLine.compare(0, 4, "GET ") != 0 || !respond(connection, target))
+			return;
+	}
+}
+
+
+bool ChartServer::respond(StreamConnection& connection, const string& target)
+{
+	requestCount.fetch_add(1, memory_order_relaxed);
+
+	if (latencyMs > 0)
+		this_thread::sleep_for(milliseconds(latencyMs));
+
+	string status = "200 OK";
+	string body;
+
+	if (target.compare(0, ChartPath.size(), ChartPath) != 0)
+	{
+		status = "404 Not Found";
+		body = "{\"chart\":{\"result\":null,\"error\":{\"code\":\"Not Found\",\"description\":\"No data found\"}}}";
+	}
+	else
+	{
+		const string symbol = decodeSymbol(target.substr(ChartPath.size(), target.find('?') - ChartPath.size()));
+		const long long period1 = queryValue(target, "period1", -1);
+		const long long period2 = queryValue(target, "period2", -1);
+
+		if (symbol.empty() || period1 < 0 || period2 < period1)
+		{
+			status = "400 Bad Request";
+			body = "{\"chart\":{\"result\":null,\"error\":{\"code\":\"Bad Request\",\"description\":\"Invalid input\"}}}";
+		}
+		else
+		{
+			body = chartBody(symbol, period1, period2);
+		}
+	}
+
+	string response = "HTTP/1.1 " + status + "\r\nContent-Type: application/json\r\nContent-Length: " + to_string(body.size()) + "\r\n\r\n";
+	response += body;
+	return connection.writeAll(response);
+}
+
+
+bool runChartServer(const string& endpointText, int latencyMs)
+{
+	_STREAM_ENDPOINT endpoint;
+	if (!_STREAM_ENDPOINT::parse(endpointText, endpoint))
+	{
+		LOG_ERROR << "Invalid endpoint " << endpointText;
+		return false;
+	}
+
+	ChartServer server(latencyMs);
+	if (!server.listen(endpoint))
+		return false;
+
+	server.run();
+	return true;
+}
+
+
+bool checkDownloadEngine(const string& endpointText, size_t maxInFlight, size_t symbols, size_t days)
+{
+	_STREAM_ENDPOINT endpoint;
+	if (!_STREAM_ENDPOINT::parse(endpointText, endpoint))
+	{
+		LOG_ERROR << "Invalid endpoint " << endpointText;
+		return false;
+	}
+
+	ChartServer server;
+	if (!server.start(endpoint))
+		return false;
+
+	// regular sessions, 14:30 to 21:00 UTC, from Monday 2025-11-03 on
+	const long long FirstDay = 1762128000;
+	const string baseURL = "http://" + endpoint.host + ":" + endpoint.port;
+
+	struct _EXPECTED
+	{
+		string symbol;
+		long long period1;
+		long long period2;
+		size_t answers;
+	};
+
+	vector<_EXPECTED> expected;
+	for (size_t s = 0; s < symbols; ++s)
+	{
+		for (size_t d = 0; d < days; ++d)
+		{
+			long long day = FirstDay + static_cast<long long>(d) * 86400;
+			expected.push_back(_EXPECTED{ "CHK" + to_string(s), day + 14 * 3600 + 1800, day + 21 * 3600, 0 });
+		}
+	}
+
+	size_t failed = 0;
+	size_t mismatched = 0;
+	size_t delivered = 0;
+	auto started = steady_clock::now();
+	{
+		DownloadEngine engine(maxInFlight);
+		for (size_t i = 0; i < expected.size(); ++i)
+		{
+			engine.add(baseURL + ChartPath + expected[i].symbol + "?period1=" + to_string(expected[i].period1)
+				+ "&period2=" + to_string(expected[i].period2) + "&interval=1m", i);
+		}
+
+		delivered = engine.run([&](_DOWNLOAD_RESULT& result)
+		{
+			if (result.tag >= expected.size())
+			{
+				++mismatched;
+				return;
+			}
+
+			_EXPECTED& request = expected[result.tag];
+			++request.answers;
+
+			if (result.curlCode != CURLE_OK || result.httpCode != 200)
+			{
+				LOG_ERROR << result.url << " failed with " << result.httpCode << ", " << curl_easy_strerror(result.curlCode);
+				++failed;
+			}
+			else if (result.body != ChartServer::chartBody(request.symbol, request.period1, request.period2))
+			{
+				LOG_ERROR << result.url << " returned another body than was served";
+				++mismatched;
+			}
+		});
+	}
+	double elapsed = duration<double>(steady_clock::now() - started).count();
+
+	server.stop();
+
+	size_t unanswered = std::count_if(expected.begin(), expected.end(), [](const _EXPECTED& e) { return e.answers != 1; });
+	bool lOK = delivered == expected.size() && unanswered == 0 && failed == 0 && mismatched == 0;
+
+	LOG_INFO << "Fetched " << delivered << " of " << expected.size() << " chart(s) in " << elapsed << "s with " << maxInFlight
+		<< " in flight, " << server.requests() << " request(s) served";
+
+	if (lOK)
+		LOG_INFO << "Download engine check passed";
+	else
+		LOG_ERROR << "Download engine check failed: " << failed << " failed, " << mismatched << " mismatched, " << unanswered << " not answered once";
+
+	return lOK;
+}
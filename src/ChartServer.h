@@ -0,0 +1,75 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "Stream.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Stand-in for the Yahoo chart endpoint, so the download engine can be run and checked without the network:
+//
+//   TickerTape.exe /ServeYahoo=tcp://127.0.0.1:8080                    one terminal
+//   TickerTape.exe /YahooURL=http://127.0.0.1:8080                     another terminal
+//   TickerTape.exe /CheckDownload[=tcp://127.0.0.1:18080]              both in one process, see checkDownloadEngine()
+//
+// GET /v8/finance/chart/<symbol>?period1=<epoch>&period2=<epoch> is answered with a synthetic 1 minute bar
+// for every minute of [period1, period2), in the JSON layout Yahoo uses. Connections are kept alive and
+// served on a thread each, so concurrent transfers and connection reuse behave as against the real host.
+// Bars are derived from the symbol and the minute only, so every answer can be checked by the client.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+class ChartServer
+{
+public:
+	explicit ChartServer(int latencyMs = 0) : latencyMs(latencyMs) {}
+	~ChartServer() { stop(); }
+
+	ChartServer(const ChartServer&) = delete;
+	ChartServer& operator=(const ChartServer&) = delete;
+
+	// listens on a tcp:// <endpoint>; run() then serves on the calling thread, start() does both in the background
+	bool listen(const _STREAM_ENDPOINT& endpoint);
+	void run();
+	bool start(const _STREAM_ENDPOINT& endpoint);
+
+	// closes the listener and every open connection, and waits for their threads; also after run() returned
+	void stop();
+
+	size_t requests() const { return requestCount.load(std::memory_order_relaxed); }
+
+	// body the stand-in answers for <symbol> over [period1, period2)
+	static std::string chartBody(const std::string& symbol, long long period1, long long period2);
+
+private:
+	// one accepted connection and the thread serving it
+	struct _SESSION
+	{
+		std::shared_ptr<StreamConnection> connection;
+		std::thread server;
+		std::atomic<bool> bFinished{ false };
+	};
+
+	void serve(StreamConnection& connection);
+	bool respond(StreamConnection& connection, const std::string& target);
+
+	int latencyMs;
+	_STREAM_ENDPOINT endpoint;
+	std::unique_ptr<StreamListener> listener;
+	std::thread acceptor;
+	std::atomic<bool> bStopping{ false };
+
+	std::mutex lock;
+	std::vector<std::unique_ptr<_SESSION>> sessions;	// finished ones are joined as new connections arrive
+
+	std::atomic<size_t> requestCount{ 0 };
+};
+
+// /ServeYahoo: serves on <endpoint> until the process is ended
+bool runChartServer(const std::string& endpoint, int latencyMs);
+
+// /CheckDownload: starts the stand-in on <endpoint>, fetches <symbols> x <days> charts through DownloadEngine with
+// <maxInFlight> transfers and checks that every request was answered once with the bars the stand-in serves
+bool checkDownloadEngine(const std::string& endpoint, size_t maxInFlight, size_t symbols = 8, size_t days = 20);
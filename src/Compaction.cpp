@@ -0,0 +1,296 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <future>
+
+#include "Stock.h"
+#include "VolumeIndex.h"
+#include "CsvBars.h"
+#include "Log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace fs = std::filesystem;
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Compaction derives the coarser partitions from the Daily partitions written by the downloader:
+//
+//   Daily/<year>/<month>/<yyyy-mm-dd>/<SYM>_<yyyy-mm-dd>.csv   (source, one file per symbol-day)
+//   Weekly/<year>/week_<w>/<SYM>_<yyyy>-W<w>.csv
+//   Monthly/<year>/<month>/<SYM>_<yyyy-mm>.csv
+//   Yearly/<year>/<SYM>_<yyyy>.csv
+//   Single/<SYM>.csv
+//
+// Each coarse file is the time-ordered concatenation of its Daily files. Only partitions that received
+// new days are touched. When every new day sorts after the last row already in the target, the new rows
+// are appended; otherwise the target is rebuilt from its Daily files in one streaming pass. Only the CSV
+// files are derived, the downloader still saves the raw JSON response into the folder of every level.
+//
+// The volume index next to the Daily partitions, Daily/volume.index, is brought up to date alongside.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+static const string CsvHeader = "timestamp,open,high,low,close,volume";
+
+struct _DAILY_PARTITION
+{
+	string symbol;
+	string date;			// yyyy-mm-dd
+	int year;
+	int month;
+	int week;
+	fs::path csvFilename;
+	fs::file_time_type lastWrite;
+};
+
+using DailyPartitionVector = std::vector<_DAILY_PARTITION>;
+
+
+static bool parsePartitionDate(const string& date, int& year, int& month, int& week)
+{
+	std::tm tm{};
+	if (sscanf_s(date.c_str(), "%4d-%2d-%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday) != 3)
+		return false;
+
+	year = tm.tm_year;
+	month = tm.tm_mon;
+
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	tm.tm_hour = 12;
+	tm.tm_isdst = -1;
+	if (std::mktime(&tm) == (std::time_t)-1)
+		return false;
+
+	// same week numbering as makeOutputFilenames()
+	week = tm.tm_yday / 7;
+	return true;
+}
+
+
+static DailyPartitionVector findDailyPartitions(const string& basePath)
+{
+	DailyPartitionVector partitions;
+	std::error_code ec;
+
+	const fs::path dailyRoot = fs::path(basePath) / "Daily";
+	if (!fs::exists(dailyRoot, ec))
+		return partitions;
+
+	for (fs::recursive_directory_iterator itr(dailyRoot, ec), end; !ec && itr != end; itr.increment(ec))
+	{
+		if (!itr->is_regular_file(ec) || itr->path().extension() != ".csv")
+			continue;
+
+		_DAILY_PARTITION partition;
+		if (!splitPartitionStem(itr->path().stem().string(), partition.symbol, partition.date)
+			|| !parsePartitionDate(partition.date, partition.year, partition.month, partition.week))
+			continue;
+
+		partition.csvFilename = itr->path();
+		partition.lastWrite = itr->last_write_time(ec);
+		partitions.push_back(partition);
+	}
+
+	std::sort(partitions.begin(), partitions.end(), [](const _DAILY_PARTITION& a, const _DAILY_PARTITION& b)
+	{
+		return a.symbol != b.symbol ? a.symbol < b.symbol : a.date < b.date;
+	});
+
+	return partitions;
+}
+
+
+static fs::path makeRollupFilename(const string& basePath, SaveType level, const _DAILY_PARTITION& day)
+{
+	const fs::path base(basePath);
+	const string year = std::to_string(day.year);
+	char monthbuf[8];
+	snprintf(monthbuf, sizeof(monthbuf), "%02d", day.month);
+
+	switch (level)
+	{
+	case SaveType::WeeklyFile:
+		return base / "Weekly" / year / ("week_" + std::to_string(day.week)) / (day.symbol + "_" + year + "-W" + std::to_string(day.week) + ".csv");
+	case SaveType::MonthlyFile:
+		return base / "Monthly" / year / std::to_string(day.month) / (day.symbol + "_" + year + "-" + monthbuf + ".csv");
+	case SaveType::YearlyFile:
+		return base / "Yearly" / year / (day.symbol + "_" + year + ".csv");
+	case SaveType::SingleFile:
+		return base / "Single" / (day.symbol + ".csv");
+	default:
+		return fs::path();
+	}
+}
+
+
+// first timestamp column of the first data row in a partition file
+static string readFirstTimestamp(const fs::path& filename)
+{
+	ifstream inFile(filename, std::ios::binary);
+	string txtLine;
+
+	while (getline(inFile, txtLine))
+	{
+		if (txtLine.empty() || txtLine.compare(0, CsvHeader.size(), CsvHeader) == 0)
+			continue;
+
+		return txtLine.substr(0, txtLine.find(','));
+	}
+
+	return string();
+}
+
+
+// timestamp column of the last data row, read from the tail so large rollups are not rescanned
+static string readLastTimestamp(const fs::path& filename)
+{
+	ifstream inFile(filename, std::ios::binary | std::ios::ate);
+	if (!inFile)
+		return string();
+
+	const std::streamoff size = inFile.tellg();
+	const std::streamoff tail = std::min<std::streamoff>(size, 4096);
+	string buffer(static_cast<size_t>(tail), '\0');
+
+	inFile.seekg(size - tail);
+	inFile.read(buffer.data(), tail);
+
+	while (!buffer.empty() && (buffer.back() == '\n' || buffer.back() == '\r'))
+		buffer.pop_back();
+
+	size_t start = buffer.rfind('\n');
+	string txtLine = buffer.substr(start == string::npos ? 0 : start + 1);
+	if (txtLine.compare(0, CsvHeader.size(), CsvHeader) == 0)
+		return string();
+
+	return txtLine.substr(0, txtLine.find(','));
+}
+
+
+// stream the data rows of a Daily file into the target using large block copies
+static bool appendDailyRows(ofstream& target, const fs::path& dailyFilename, vector<char>& block)
+{
+	ifstream inFile(dailyFilename, std::ios::binary);
+	if (!inFile)
+		return false;
+
+	// skip the header line
+	string txtLine;
+	getline(inFile, txtLine);
+	if (txtLine.compare(0, CsvHeader.size(), CsvHeader) != 0)
+		target << txtLine << '\n';
+
+	while (inFile)
+	{
+		inFile.read(block.data(), block.size());
+		target.write(block.data(), inFile.gcount());
+	}
+
+	return true;
+}
+
+
+static bool compactPartition
+(
+	const fs::path& target,
+	const vector<const _DAILY_PARTITION*>& days,
+	bool bIncremental,
+	vector<char>& block
+)
+{
+	std::error_code ec;
+	bool exists = fs::exists(target, ec);
+	fs::file_time_type targetTime = exists ? fs::last_write_time(target, ec) : fs::file_time_type::min();
+
+	vector<const _DAILY_PARTITION*> newDays;
+	for (auto day : days)
+	{
+		if (!exists || !bIncremental || day->lastWrite > targetTime)
+			newDays.push_back(day);
+	}
+
+	if (newDays.empty())
+		return true;
+
+	// append when the new days strictly follow what the rollup already holds
+	bool bAppend = exists && bIncremental;
+	if (bAppend)
+	{
+		const string lastTimestamp = readLastTimestamp(target);
+		const string firstNewTimestamp = readFirstTimestamp(newDays.front()->csvFilename);
+		bAppend = !lastTimestamp.empty() && !firstNewTimestamp.empty() && lastTimestamp < firstNewTimestamp;
+	}
+
+	fs::create_directories(target.parent_path(), ec);
+
+	// rebuilds go to a temporary file so readers never see a half written rollup
+	const fs::path tmpTarget = fs::path(target).concat(".tmp");
+	ofstream outFile(bAppend ? target : tmpTarget, std::ios::binary | (bAppend ? std::ios::app : std::ios::trunc));
+	if (!outFile)
+	{
+		LOG_ERROR << "Cannot open " << target.string();
+		return false;
+	}
+
+	if (!bAppend)
+		outFile << CsvHeader << '\n';
+
+	bool lOK = true;
+	for (auto day : bAppend ? newDays : days)
+		lOK &= appendDailyRows(outFile, day->csvFilename, block);
+
+	outFile.close();
+
+	if (!bAppend)
+	{
+		fs::rename(tmpTarget, target, ec);
+		lOK &= !ec;
+	}
+
+	return lOK;
+}
+
+
+bool compactPartitions(const string& basePath, SaveType saveType, bool bIncremental)
+{
+	const DailyPartitionVector partitions = findDailyPartitions(basePath);
+	if (partitions.empty())
+		return true;
+
+	const SaveType levels[] = { SaveType::WeeklyFile, SaveType::MonthlyFile, SaveType::YearlyFile, SaveType::SingleFile };
+	vector<char> block(1 << 20);
+	bool lOK = true;
+	int written = 0;
+
+	for (SaveType level : levels)
+	{
+		if ((saveType & level) == SaveType::None)
+			continue;
+
+		// group the (symbol, date) ordered Daily partitions by rollup file, order within a group is preserved
+		map<fs::path, vector<const _DAILY_PARTITION*>> rollups;
+		for (const auto& day : partitions)
+			rollups[makeRollupFilename(basePath, level, day)].push_back(&day);
+
+		for (const auto& rollup : rollups)
+		{
+			lOK &= compactPartition(rollup.first, rollup.second, bIncremental, block);
+			++written;
+		}
+	}
+
+	LOG_INFO << "Compacted " << partitions.size() << " daily partitions into " << written << " rollups";
+
+	lOK = updateVolumeIndex(basePath) && lOK;
+	return lOK;
+}
+
+
+std::future<bool> compactPartitionsAsync(const string& basePath, SaveType saveType, bool bIncremental)
+{
+	return std::async(std::launch::async, compactPartitions, basePath, saveType, bIncremental);
+}
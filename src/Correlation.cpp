@@ -0,0 +1,327 @@
+#include <cmath>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+
+// MSVC has FMA with /arch:AVX2, GCC and clang need -mfma as well
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define CORRELATION_AVX2
+#include <immintrin.h>
+#endif
+
+#include "Correlation.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+constexpr size_t Lanes = 8;					// accumulator lanes, rows are padded to a multiple
+constexpr size_t TileSymbols = 32;			// symbols per side of a tile
+constexpr size_t ChunkMinutes = 512;		// minutes of a tile streamed at once, a multiple of Lanes
+constexpr long long MaxReturnSeconds = 60;	// longer grid steps are closes, weekends or halts, not minute returns
+
+// the aligned returns, [symbol][minute] with rows <stride> apart
+struct _RETURN_MATRIX
+{
+	size_t symbols = 0;
+	size_t minutes = 0;
+	size_t stride = 0;
+	vector<double> x;						// log return, 0 when missing
+	vector<uint8_t> m;						// 1 when the return exists
+
+	// per symbol totals over the whole range
+	vector<double> sumX;
+	vector<double> sumQ;					// sum of squares
+	vector<double> count;
+	vector<vector<uint32_t>> missing;		// minutes without a return
+};
+
+
+static void alignReturns(const BarStore& store, long long from, long long to, _CORRELATION_MATRIX& result, _RETURN_MATRIX& returns)
+{
+	auto guard = store.lockShared();
+	const BarSeriesMap& series = store.series();
+
+	// the grid is every minute any symbol has a bar at
+	vector<long long> grid;
+	vector<pair<const _BAR_SERIES*, pair<size_t, size_t>>> rows;
+
+	for (const auto& entry : series)
+	{
+		const size_t first = entry.second.lowerBound(from);
+		const size_t last = entry.second.lowerBound(to);
+		if (first == last)
+			continue;
+
+		result.symbols.push_back(entry.first);
+		rows.push_back({ &entry.second, { first, last } });
+		grid.insert(grid.end(), entry.second.timestamp.begin() + first, entry.second.timestamp.begin() + last);
+	}
+
+	std::sort(grid.begin(), grid.end());
+	grid.erase(std::unique(grid.begin(), grid.end()), grid.end());
+
+	const size_t S = rows.size();
+	const size_t R = grid.size() > 1 ? grid.size() - 1 : 0;
+
+	returns.symbols = S;
+	returns.minutes = R;
+	returns.stride = (R + Lanes - 1) / Lanes * Lanes;
+	returns.x.assign(S * returns.stride, 0.0);
+	returns.m.assign(S * returns.stride, 0);
+	returns.sumX.assign(S, 0.0);
+	returns.sumQ.assign(S, 0.0);
+	returns.count.assign(S, 0.0);
+	returns.missing.assign(S, {});
+
+	for (size_t s = 0; s < S; ++s)
+	{
+		const _BAR_SERIES& bars = *rows[s].first;
+		double* x = returns.x.data() + s * returns.stride;
+		uint8_t* m = returns.m.data() + s * returns.stride;
+
+		// both sides are sorted, so the grid position only moves forward
+		size_t g = 0;
+		size_t previous = SIZE_MAX;
+		double previousClose = 0.0;
+
+		for (size_t row = rows[s].second.first; row < rows[s].second.second; ++row)
+		{
+			while (grid[g] < bars.timestamp[row])
+				++g;
+
+			const double close = bars.close[row];
+			if (previous != SIZE_MAX && g == previous + 1 && grid[g] - grid[previous] <= MaxReturnSeconds && close > 0.0 && previousClose > 0.0)
+			{
+				const double r = std::log(close / previousClose);
+				x[previous] = r;
+				m[previous] = 1;
+
+				returns.sumX[s] += r;
+				returns.sumQ[s] += r * r;
+				returns.count[s] += 1.0;
+			}
+
+			previous = g;
+			previousClose = close;
+		}
+
+		for (size_t t = 0; t < R; ++t)
+		{
+			if (!m[t])
+				returns.missing[s].push_back(static_cast<uint32_t>(t));
+		}
+	}
+
+	result.minutes = R;
+}
+
+
+// sum(a b) over n values, n a multiple of Lanes
+static double dotKernel(const double* __restrict a, const double* __restrict b, size_t n)
+{
+	double s[Lanes] = {};
+
+	for (size_t t = 0; t < n; t += Lanes)
+		for (size_t k = 0; k < Lanes; ++k)
+			s[k] += a[t + k] * b[t + k];
+
+	double total = 0.0;
+	for (size_t k = 0; k < Lanes; ++k)
+		total += s[k];
+	return total;
+}
+
+
+// sum(a b0) .. sum(a b3): every load of <a> feeds four products
+static void dot4Kernel(const double* __restrict a, const double* __restrict b0, const double* __restrict b1,
+	const double* __restrict b2, const double* __restrict b3, size_t n, double* __restrict out)
+{
+#ifdef CORRELATION_AVX2
+	__m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(), s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+	__m256d t0 = _mm256_setzero_pd(), t1 = _mm256_setzero_pd(), t2 = _mm256_setzero_pd(), t3 = _mm256_setzero_pd();
+
+	for (size_t t = 0; t < n; t += 8)
+	{
+		const __m256d x = _mm256_loadu_pd(a + t);
+		const __m256d y = _mm256_loadu_pd(a + t + 4);
+		s0 = _mm256_fmadd_pd(x, _mm256_loadu_pd(b0 + t), s0);
+		s1 = _mm256_fmadd_pd(x, _mm256_loadu_pd(b1 + t), s1);
+		s2 = _mm256_fmadd_pd(x, _mm256_loadu_pd(b2 + t), s2);
+		s3 = _mm256_fmadd_pd(x, _mm256_loadu_pd(b3 + t), s3);
+		t0 = _mm256_fmadd_pd(y, _mm256_loadu_pd(b0 + t + 4), t0);
+		t1 = _mm256_fmadd_pd(y, _mm256_loadu_pd(b1 + t + 4), t1);
+		t2 = _mm256_fmadd_pd(y, _mm256_loadu_pd(b2 + t + 4), t2);
+		t3 = _mm256_fmadd_pd(y, _mm256_loadu_pd(b3 + t + 4), t3);
+	}
+
+	alignas(32) double lanes[4][4];
+	_mm256_store_pd(lanes[0], _mm256_add_pd(s0, t0));
+	_mm256_store_pd(lanes[1], _mm256_add_pd(s1, t1));
+	_mm256_store_pd(lanes[2], _mm256_add_pd(s2, t2));
+	_mm256_store_pd(lanes[3], _mm256_add_pd(s3, t3));
+
+	for (size_t j = 0; j < 4; ++j)
+		out[j] += lanes[j][0] + lanes[j][1] + lanes[j][2] + lanes[j][3];
+#else
+	constexpr size_t L = 4;
+	double s0[L] = {}, s1[L] = {}, s2[L] = {}, s3[L] = {};
+
+	for (size_t t = 0; t < n; t += L)
+	{
+		for (size_t k = 0; k < L; ++k)
+		{
+			s0[k] += a[t + k] * b0[t + k];
+			s1[k] += a[t + k] * b1[t + k];
+			s2[k] += a[t + k] * b2[t + k];
+			s3[k] += a[t + k] * b3[t + k];
+		}
+	}
+
+	for (size_t k = 0; k < L; ++k)
+	{
+		out[0] += s0[k];
+		out[1] += s1[k];
+		out[2] += s2[k];
+		out[3] += s3[k];
+	}
+#endif
+}
+
+
+_CORRELATION_MATRIX CorrelationEngine::compute(const BarStore& store, long long from, long long to) const
+{
+	_CORRELATION_MATRIX result;
+	_RETURN_MATRIX returns;
+	alignReturns(store, from, to, result, returns);
+
+	const size_t S = returns.symbols;
+	const size_t stride = returns.stride;
+	const double minimum = static_cast<double>(std::max<size_t>(minOverlap, 2));
+
+	result.correlation.assign(S * S, NAN);
+	result.covariance.assign(S * S, NAN);
+	result.overlap.assign(S * S, 0);
+
+	// upper triangle of tiles, the diagonal tiles included
+	const size_t tiles = (S + TileSymbols - 1) / TileSymbols;
+	vector<pair<size_t, size_t>> work;
+	for (size_t bi = 0; bi < tiles; ++bi)
+		for (size_t bj = bi; bj < tiles; ++bj)
+			work.emplace_back(bi, bj);
+
+	auto finish = [&](size_t i, size_t j, double n, double sxy, double sx, double sy, double sxx, double syy)
+	{
+		result.overlap[i * S + j] = result.overlap[j * S + i] = static_cast<uint32_t>(n);
+		if (n < minimum)
+			return;
+
+		const double cxy = sxy - sx * sy / n;
+		const double vx = sxx - sx * sx / n;
+		const double vy = syy - sy * sy / n;
+
+		result.covariance[i * S + j] = result.covariance[j * S + i] = cxy / (n - 1.0);
+		if (vx > 0.0 && vy > 0.0)
+			result.correlation[i * S + j] = result.correlation[j * S + i] = std::clamp(cxy / std::sqrt(vx * vy), -1.0, 1.0);
+	};
+
+	// The missing minutes are sparse for liquid symbols, so the masked sums are the totals minus the few
+	// minutes the other symbol lacks: sum(xi mj) = sum(xi) - sum over missing j of xi, and likewise for
+	// sum(xi^2 mj) and sum(mi mj). Only sum(xi xj) needs the full dot product, missing returns being 0.
+	auto finishPair = [&](size_t i, size_t j, double sxy)
+	{
+		const double* xi = returns.x.data() + i * stride;
+		const double* xj = returns.x.data() + j * stride;
+		const uint8_t* mi = returns.m.data() + i * stride;
+
+		double n = returns.count[i], sx = returns.sumX[i], sxx = returns.sumQ[i];
+		for (uint32_t t : returns.missing[j])
+		{
+			n -= mi[t];
+			sx -= xi[t];
+			sxx -= xi[t] * xi[t];
+		}
+
+		double sy = returns.sumX[j], syy = returns.sumQ[j];
+		for (uint32_t t : returns.missing[i])
+		{
+			sy -= xj[t];
+			syy -= xj[t] * xj[t];
+		}
+
+		finish(i, j, n, sxy, sx, sy, sxx, syy);
+	};
+
+	atomic<size_t> nextTile{ 0 };
+	auto worker = [&]()
+	{
+		vector<double> sxy(TileSymbols * TileSymbols);
+
+		for (size_t w = nextTile.fetch_add(1); w < work.size(); w = nextTile.fetch_add(1))
+		{
+			const size_t i0 = work[w].first * TileSymbols, i1 = std::min(i0 + TileSymbols, S);
+			const size_t j0 = work[w].second * TileSymbols, j1 = std::min(j0 + TileSymbols, S);
+			std::fill(sxy.begin(), sxy.end(), 0.0);
+
+			// a chunk of every row of both tiles stays in cache while all their pairs use it
+			for (size_t c = 0; c < stride; c += ChunkMinutes)
+			{
+				const size_t n = std::min(ChunkMinutes, stride - c);
+
+				for (size_t i = i0; i < i1; ++i)
+				{
+					const double* xi = returns.x.data() + i * stride + c;
+					double* out = sxy.data() + (i - i0) * TileSymbols;
+
+					size_t j = std::max(j0, i);
+					for (; j + 4 <= j1; j += 4)
+					{
+						const double* xj = returns.x.data() + j * stride + c;
+						dot4Kernel(xi, xj, xj + stride, xj + 2 * stride, xj + 3 * stride, n, out + (j - j0));
+					}
+
+					for (; j < j1; ++j)
+						out[j - j0] += dotKernel(xi, returns.x.data() + j * stride + c, n);
+				}
+			}
+
+			for (size_t i = i0; i < i1; ++i)
+				for (size_t j = std::max(j0, i); j < j1; ++j)
+					finishPair(i, j, sxy[(i - i0) * TileSymbols + (j - j0)]);
+		}
+	};
+
+	runWorkers(std::min(workers != 0 ? workers : getThreadPool().size(), std::max<size_t>(work.size(), 1)), worker);
+
+	return result;
+}
+
+
+bool writeCorrelationCSV(const _CORRELATION_MATRIX& matrix, const string& filename)
+{
+	ofstream out(filename, ios::binary | ios::trunc);
+	if (!out)
+		return false;
+
+	const size_t S = matrix.size();
+	string text = "symbol";
+	for (const auto& symbol : matrix.symbols)
+		text += "," + symbol;
+	text += '\n';
+
+	char value[32];
+	for (size_t i = 0; i < S; ++i)
+	{
+		text += matrix.symbols[i];
+		for (size_t j = 0; j < S; ++j)
+		{
+			double c = matrix.at(i, j);
+			int n = std::isnan(c) ? 0 : snprintf(value, sizeof(value), "%.6f", c);
+			text += ',';
+			text.append(value, n > 0 ? static_cast<size_t>(n) : 0);
+		}
+		text += '\n';
+	}
+
+	out.write(text.data(), text.size());
+	return out.good();
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <climits>
+
+#include "BarStore.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Pairwise correlation and covariance of minute log returns across the symbol universe.
+//
+// The symbols' closes are aligned on the union of their bar times into a dense [symbol][minute] matrix
+// of returns. A return exists where a symbol has bars at both of two consecutive minutes of the grid
+// that are a minute apart, so no return spans a close or a weekend; missing returns are stored as 0
+// with a 0 in a parallel mask. Every pair then uses exactly the minutes both symbols have (pairwise
+// complete): sum(xi xj) is a plain dot product because missing returns are 0, and the other sums are
+// the symbols' totals less the minutes the other symbol is missing.
+//
+// The pairs are computed in square tiles of symbols, streamed through in chunks of minutes that fit in
+// L1/L2 together; tiles are handed out to the shared thread pool. The inner kernel computes four dot products
+// per load of a row with AVX2 where the build enables it, as the Release configurations do, and otherwise
+// keeps independent accumulator lanes that compilers vectorize without relaxing floating point semantics.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+struct _CORRELATION_MATRIX
+{
+	std::vector<std::string> symbols;
+	size_t minutes = 0;						// returns on the aligned grid
+	std::vector<double> correlation;		// [symbols x symbols], NaN where the pair overlaps too little
+	std::vector<double> covariance;
+	std::vector<uint32_t> overlap;			// common returns of each pair
+
+	size_t size() const { return symbols.size(); }
+	double at(size_t i, size_t j) const { return correlation[i * symbols.size() + j]; }
+};
+
+class CorrelationEngine
+{
+public:
+	// pairs with fewer than minOverlap common returns get NaN
+	explicit CorrelationEngine(size_t workers = 0, size_t minOverlap = 30) : workers(workers), minOverlap(minOverlap) {}
+
+	// symbols of <store> with bars in [from, to), UTC epoch seconds
+	_CORRELATION_MATRIX compute(const BarStore& store, long long from = LLONG_MIN, long long to = LLONG_MAX) const;
+
+private:
+	size_t workers;
+	size_t minOverlap;
+};
+
+// symbols in the first row and column
+bool writeCorrelationCSV(const _CORRELATION_MATRIX& matrix, const std::string& filename);
@@ -0,0 +1,244 @@
+#include <charconv>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "CsvBars.h"
+#include "Log.h"
+
+using namespace std;
+
+void appendBarCSV(string& text, const _BAR& bar)
+{
+	char line[160];
+	int n = snprintf(line, sizeof(line), "%s,%g,%g,%g,%g,%lld\n",
+		epoch_to_utc_string(static_cast<long>(bar.timestamp)).c_str(), bar.open, bar.high, bar.low, bar.close, bar.volume);
+
+	if (n > 0) text.append(line, std::min(static_cast<size_t>(n), sizeof(line) - 1));
+}
+
+
+// seconds to add to US/Eastern wall clock time for UTC: EDT from 2:00 on the second Sunday of March to
+// 2:00 on the first Sunday of November, EST otherwise. The repeated hour in November is read as EDT.
+static long long usEasternOffset(int year, int month, int day, int hour)
+{
+	// 1970-01-01 was a Thursday; weekday 0 is Sunday
+	auto firstSunday = [year](int m)
+	{
+		int weekday = static_cast<int>((daysFromCivil(year, m, 1) + 4) % 7);
+		return 1 + (7 - weekday) % 7;
+	};
+
+	bool bDaylight = month > 3 && month < 11;
+	if (month == 3)
+	{
+		const int start = firstSunday(3) + 7;
+		bDaylight = day > start || (day == start && hour >= 2);
+	}
+	else if (month == 11)
+	{
+		const int end = firstSunday(11);
+		bDaylight = day < end || (day == end && hour < 2);
+	}
+
+	return (bDaylight ? 4 : 5) * 3600;
+}
+
+
+template <typename T>
+static bool parseNumber(string_view text, T& value)
+{
+	auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+	return ec == std::errc() && ptr == text.data() + text.size();
+}
+
+
+// next comma separated field of <line>, consumed from the front
+static string_view nextField(string_view& line)
+{
+	size_t comma = line.find(',');
+	string_view field = line.substr(0, comma);
+	line.remove_prefix(comma == string_view::npos ? line.size() : comma + 1);
+	return field;
+}
+
+
+bool CsvBarParser::parseTimestamp(string_view text, long long& epoch)
+{
+	int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+
+	if (text.size() < 10 || text[4] != '-' || text[7] != '-'
+		|| !parseNumber(text.substr(0, 4), year) || !parseNumber(text.substr(5, 2), month) || !parseNumber(text.substr(8, 2), day))
+		return false;
+
+	if (text.size() >= 19)
+	{
+		if (text[13] != ':' || text[16] != ':'
+			|| !parseNumber(text.substr(11, 2), hour) || !parseNumber(text.substr(14, 2), minute) || !parseNumber(text.substr(17, 2), second))
+			return false;
+	}
+
+	const long long civil = daysFromCivil(year, month, day) * 86400;
+
+	if (timeZone == CsvTimeZone::Utc)
+	{
+		epoch = civil + hour * 3600 + minute * 60 + second;
+		return true;
+	}
+
+	if (timeZone == CsvTimeZone::UsEastern)
+	{
+		epoch = civil + hour * 3600 + minute * 60 + second + usEasternOffset(year, month, day, hour);
+		return true;
+	}
+
+	if (memcmp(cachedDate, text.data(), sizeof(cachedDate)) != 0)
+	{
+		std::tm tm{};
+		tm.tm_year = year - 1900;
+		tm.tm_mon = month - 1;
+		tm.tm_mday = day;
+		tm.tm_hour = 12;
+		tm.tm_isdst = -1;
+
+		std::time_t noon = std::mktime(&tm);
+		if (noon == (std::time_t)-1)
+			return false;
+
+		cachedOffset = civil + 12 * 3600 - static_cast<long long>(noon);
+		memcpy(cachedDate, text.data(), sizeof(cachedDate));
+	}
+
+	epoch = civil + hour * 3600 + minute * 60 + second - cachedOffset;
+	return true;
+}
+
+
+void CsvBarParser::parseLine(string_view line)
+{
+	if (!line.empty() && line.back() == '\r')
+		line.remove_suffix(1);
+
+	if (line.empty())
+		return;
+
+	if (!bStarted)
+	{
+		bStarted = true;
+
+		// errors and throttling come back as JSON even when CSV was requested
+		if (line.front() == '{')
+		{
+			bMessage = true;
+			return;
+		}
+
+		if (line.compare(0, 9, "timestamp") == 0)
+			return;
+	}
+
+	string_view timestamp = nextField(line);
+
+	_BAR bar{};
+	bool lOK = parseTimestamp(timestamp, bar.timestamp);
+	lOK = lOK && parseNumber(nextField(line), bar.open);
+	lOK = lOK && parseNumber(nextField(line), bar.high);
+	lOK = lOK && parseNumber(nextField(line), bar.low);
+	lOK = lOK && parseNumber(nextField(line), bar.close);
+	lOK = lOK && parseNumber(nextField(line), bar.volume);
+
+	if (!lOK)
+	{
+		++rejectedCount;
+		return;
+	}
+
+	++rowCount;
+	onRow(timestamp, bar);
+}
+
+
+bool CsvBarParser::feed(string_view chunk)
+{
+	if (bMessage)
+		return false;
+
+	// finish the line left over from the previous chunk
+	if (!partial.empty())
+	{
+		size_t newline = chunk.find('\n');
+		if (newline == string_view::npos)
+		{
+			partial.append(chunk);
+			return true;
+		}
+
+		partial.append(chunk.substr(0, newline));
+		parseLine(partial);
+		partial.clear();
+		chunk.remove_prefix(newline + 1);
+	}
+
+	for (size_t newline; !bMessage && (newline = chunk.find('\n')) != string_view::npos;)
+	{
+		parseLine(chunk.substr(0, newline));
+		chunk.remove_prefix(newline + 1);
+	}
+
+	if (!bMessage)
+		partial.assign(chunk);
+
+	return !bMessage;
+}
+
+
+bool CsvBarParser::finish()
+{
+	if (!partial.empty() && !bMessage)
+		parseLine(partial);
+
+	partial.clear();
+	return !bMessage;
+}
+
+
+bool splitPartitionStem(string_view stem, string& symbol, string& period)
+{
+	size_t sep = stem.rfind('_');
+	if (sep == string_view::npos || sep == 0 || sep + 1 == stem.size())
+		return false;
+
+	symbol.assign(stem.substr(0, sep));
+	period.assign(stem.substr(sep + 1));
+	return true;
+}
+
+
+bool readPartitionFile(const std::filesystem::path& filename, const function<void(const _BAR& bar)>& onBar, size_t* rejected)
+{
+	ifstream in(filename, ios::binary);
+	if (!in)
+	{
+		LOG_ERROR << "Cannot open " << filename.string();
+		return false;
+	}
+
+	// one read buffer per thread, loaders call this for thousands of files
+	thread_local vector<char> buffer(1 << 16);
+
+	CsvBarParser parser([&onBar](string_view, const _BAR& bar) { onBar(bar); }, CsvTimeZone::Utc);
+
+	while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0)
+		parser.feed(string_view(buffer.data(), static_cast<size_t>(in.gcount())));
+	parser.finish();
+
+	if (rejected)
+		*rejected += parser.rejected();
+	else if (parser.rejected() > 0)
+		LOG_WARNING << "Skipped " << parser.rejected() << " malformed row(s) in " << filename.string();
+
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <functional>
+#include <filesystem>
+
+#include "Stock.h"
+
+// Incremental parser for "timestamp,open,high,low,close,volume" CSV as returned by Alpha Vantage with
+// datatype=csv. Input can be fed in arbitrary chunks; every complete row is handed to the callback with
+// its timestamp text as received and the bar converted to epoch seconds. Fields are parsed in place with
+// std::from_chars, nothing is allocated per row.
+//
+// Timestamps are "yyyy-mm-dd" or "yyyy-mm-dd hh:mm:ss". Alpha Vantage sends US/Eastern exchange time
+// whatever the machine's time zone is; the partitions this project writes are in UTC. A body that starts
+// with '{' is an Alpha Vantage error or throttle message.
+enum class CsvTimeZone
+{
+	Utc,
+	Local,				// the machine's time zone, like parseDateToEpoch()
+	UsEastern			// NYSE/Nasdaq time, EST/EDT with the US daylight saving rules since 2007
+};
+
+// header of the bar CSV files this project writes, the format CsvBarParser reads back
+constexpr std::string_view BarCsvHeader = "timestamp,open,high,low,close,volume\n";
+
+// appends <bar> to <text> as one "yyyy-mm-dd hh:mm:ss,open,high,low,close,volume" row in UTC
+void appendBarCSV(std::string& text, const _BAR& bar);
+
+class CsvBarParser
+{
+public:
+	using RowCallback = std::function<void(std::string_view timestamp, const _BAR& bar)>;
+
+	explicit CsvBarParser(RowCallback onRow, CsvTimeZone timeZone = CsvTimeZone::UsEastern) : onRow(std::move(onRow)), timeZone(timeZone) {}
+
+	// returns false once the input turned out not to be CSV rows
+	bool feed(std::string_view chunk);
+	bool finish();
+
+	size_t rows() const { return rowCount; }
+	size_t rejected() const { return rejectedCount; }
+	bool isMessage() const { return bMessage; }
+
+private:
+	void parseLine(std::string_view line);
+	bool parseTimestamp(std::string_view text, long long& epoch);
+
+	RowCallback onRow;
+	CsvTimeZone timeZone;
+	std::string partial;
+	bool bStarted = false;
+	bool bMessage = false;
+	size_t rowCount = 0;
+	size_t rejectedCount = 0;
+
+	// UTC offset of the last date seen, taken at noon, so mktime() runs once per day rather than once per row
+	char cachedDate[10] = {};
+	long long cachedOffset = 0;
+};
+
+// Partition files, <SYM>_<period>.csv such as AAPL_2025-11-03.csv or BRK_B_2025-W45.csv: the stem splits at
+// its last '_', as symbols may themselves contain '_'; false when either part is empty
+bool splitPartitionStem(std::string_view stem, std::string& symbol, std::string& period);
+
+// Streams the rows of a partition file to <onBar>. Partitions are written by this project, so timestamps
+// are UTC whichever source they came from. Malformed rows are skipped and counted into <rejected>, or
+// logged per file without it; false when the file cannot be opened.
+bool readPartitionFile(const std::filesystem::path& filename, const std::function<void(const _BAR& bar)>& onBar, size_t* rejected = nullptr);
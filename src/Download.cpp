@@ -0,0 +1,348 @@
+#include <iostream>
+#include <algorithm>
+
+#include "Download.h"
+#include "RateLimiter.h"
+#include "Cassette.h"
+#include "Log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+
+static size_t TransferWriteCallback(void* contents, size_t size, size_t nmemb, void* userp)
+{
+	size_t totalSize = size * nmemb;
+	std::string* str = static_cast<std::string*>(userp);
+	str->append(static_cast<char*>(contents), totalSize);
+	return totalSize;
+}
+
+
+string BufferPool::endpointOf(const string& url)
+{
+	return url.substr(0, url.find('?'));
+}
+
+
+string BufferPool::acquire(const string& endpoint)
+{
+	string buffer;
+	size_t hint = 0;
+	{
+		lock_guard<mutex> guard(lock);
+
+		auto itr = sizeHints.find(endpoint);
+		if (itr != sizeHints.end())
+			hint = itr->second;
+
+		// prefer the smallest pooled buffer that already fits the hint
+		auto best = buffers.end();
+		for (auto b = buffers.begin(); b != buffers.end(); ++b)
+		{
+			if (b->capacity() >= hint && (best == buffers.end() || b->capacity() < best->capacity()))
+				best = b;
+		}
+
+		if (best == buffers.end() && !buffers.empty())
+			best = std::max_element(buffers.begin(), buffers.end(), [](const string& a, const string& b) { return a.capacity() < b.capacity(); });
+
+		if (best != buffers.end())
+		{
+			buffer = std::move(*best);
+			buffers.erase(best);
+		}
+	}
+
+	buffer.clear();
+	buffer.reserve(hint);
+	return buffer;
+}
+
+
+void BufferPool::recordSize(const string& endpoint, size_t size)
+{
+	lock_guard<mutex> guard(lock);
+
+	// decaying maximum with some headroom, one unusually large response does not pin memory for long
+	size_t& hint = sizeHints[endpoint];
+	hint = std::max(size + size / 8, hint - hint / 8);
+}
+
+
+void BufferPool::release(string&& buffer)
+{
+	// buffers moved out by the caller come back empty, oversized ones are not worth keeping
+	if (buffer.capacity() < 4096 || buffer.capacity() > (64u << 20))
+		return;
+
+	lock_guard<mutex> guard(lock);
+	if (buffers.size() < maxPooled)
+		buffers.push_back(std::move(buffer));
+}
+
+
+shared_ptr<const string> BufferPool::share(string&& buffer)
+{
+	return shared_ptr<const string>(new string(std::move(buffer)), [this](string* shared)
+	{
+		release(std::move(*shared));
+		delete shared;
+	});
+}
+
+
+BufferPool& getBufferPool()
+{
+	static BufferPool pool;
+	return pool;
+}
+
+
+DownloadEngine::DownloadEngine(size_t maxInFlight, const string& provider, int maxRetries)
+	: multi(curl_multi_init()), share(curl_share_init()), maxInFlight(std::max<size_t>(maxInFlight, 1)), provider(provider), maxRetries(maxRetries)
+{
+	// the multi handle is driven from one thread, so the share needs no lock callbacks
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+	curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(this->maxInFlight));
+	curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+}
+
+
+DownloadEngine::~DownloadEngine()
+{
+	for (auto& transfer : active)
+	{
+		if (!transfer->easy) continue;
+		curl_multi_remove_handle(multi, transfer->easy);
+		curl_easy_cleanup(transfer->easy);
+	}
+
+	for (CURL* easy : idleHandles)
+		curl_easy_cleanup(easy);
+
+	curl_multi_cleanup(multi);
+	curl_share_cleanup(share);
+}
+
+
+void DownloadEngine::add(const string& url, size_t tag)
+{
+	pending.push_back(make_unique<_TRANSFER>(_TRANSFER{ url, tag, 0, false, steady_clock::now(), BufferPool::endpointOf(url), string(), nullptr }));
+}
+
+
+CURL* DownloadEngine::acquireHandle()
+{
+	if (!idleHandles.empty())
+	{
+		CURL* easy = idleHandles.back();
+		idleHandles.pop_back();
+		return easy;
+	}
+
+	CURL* easy = curl_easy_init();
+	if (!easy) return nullptr;
+
+	curl_easy_setopt(easy, CURLOPT_SHARE, share);
+	curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, TransferWriteCallback);
+	curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(easy, CURLOPT_USERAGENT, "Mozilla/5.0 (compatible)");
+	curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, AcceptAnyEncoding);
+
+	return easy;
+}
+
+
+// starts a transfer; one that cannot get a handle goes through finish() as failed, true when it was delivered
+bool DownloadEngine::start(unique_ptr<_TRANSFER> transfer, const DownloadCallback& onComplete)
+{
+	// each transfer owns its receive buffer, sized from earlier responses of the same endpoint
+	getBufferPool().release(std::move(transfer->body));
+	transfer->body = getBufferPool().acquire(transfer->endpoint);
+
+	if (getCassette().replaying())
+	{
+		// occupies an in-flight slot until the injected latency has passed
+		transfer->easy = nullptr;
+		transfer->notBefore = steady_clock::now() + getCassette().latency();
+		active.push_back(std::move(transfer));
+		return false;
+	}
+
+	transfer->easy = acquireHandle();
+	if (!transfer->easy)
+	{
+		LOG_ERROR << "curl_easy_init failed for " << transfer->url;
+		return finish(std::move(transfer), CURLE_FAILED_INIT, 0, 0, onComplete);
+	}
+
+	curl_easy_setopt(transfer->easy, CURLOPT_URL, transfer->url.c_str());
+	curl_easy_setopt(transfer->easy, CURLOPT_WRITEDATA, &transfer->body);
+	curl_easy_setopt(transfer->easy, CURLOPT_PRIVATE, transfer.get());
+
+	curl_multi_add_handle(multi, transfer->easy);
+	active.push_back(std::move(transfer));
+	return false;
+}
+
+
+// retry or deliver a completed transfer, returns true when it was handed to the callback
+bool DownloadEngine::finish
+(
+	unique_ptr<_TRANSFER> transfer,
+	CURLcode res,
+	long http_code,
+	long long retryAfter,
+	const DownloadCallback& onComplete
+)
+{
+	transfer->bReserved = false;
+
+	if (res == CURLE_OK)
+	{
+		getCassette().record(transfer->url, http_code, transfer->body);
+
+		if (!provider.empty())
+			getRateScheduler().onResponse(provider, http_code, retryAfter);
+	}
+
+	bool bRetry = (res != CURLE_OK || http_code == 429) && transfer->attempt < maxRetries;
+	if (bRetry)
+	{
+		// transport errors back off 2,4,8... seconds, a 429 is held back by the provider's bucket
+		int wait = (1 << transfer->attempt) * 2;
+		if (res != CURLE_OK)
+			LOG_WARNING << "curl error: " << curl_easy_strerror(res) << ", retrying " << transfer->url << " in " << wait << "s";
+		else if (provider.empty())
+			LOG_WARNING << "429 received, backing off " << wait << "s";
+		else
+			LOG_WARNING << "429 received from " << provider << ", retrying " << transfer->url;
+
+		++transfer->attempt;
+		transfer->notBefore = steady_clock::now();
+		if (res != CURLE_OK || provider.empty())
+			transfer->notBefore += seconds(wait);
+
+		pending.push_back(std::move(transfer));
+		return false;
+	}
+
+	getBufferPool().recordSize(transfer->endpoint, transfer->body.size());
+
+	_DOWNLOAD_RESULT result{ std::move(transfer->url), transfer->tag, http_code, res, std::move(transfer->body) };
+	onComplete(result);
+	getBufferPool().release(std::move(result.body));
+
+	return true;
+}
+
+
+size_t DownloadEngine::run(const DownloadCallback& onComplete)
+{
+	RateScheduler& scheduler = getRateScheduler();
+	Cassette& cassette = getCassette();
+	size_t delivered = 0;
+
+	while (!pending.empty() || !active.empty())
+	{
+		// top up the in-flight window with requests whose backoff has elapsed
+		auto now = steady_clock::now();
+		size_t reserved = std::count_if(pending.begin(), pending.end(), [](const unique_ptr<_TRANSFER>& t) { return t->bReserved; });
+
+		// started after the scan, a transfer that fails to start is queued again for its retry
+		vector<unique_ptr<_TRANSFER>> starting;
+
+		for (auto itr = pending.begin(); itr != pending.end() && active.size() + starting.size() < maxInFlight;)
+		{
+			// take a slot from the provider's bucket, the transfer starts once the slot comes up.
+			// Only as many slots as free transfers are held, so a 429 still delays the rest of the queue.
+			if ((*itr)->notBefore <= now && !(*itr)->bReserved && !provider.empty() && active.size() + starting.size() + reserved < maxInFlight)
+			{
+				(*itr)->bReserved = true;
+				(*itr)->notBefore = now + scheduler.reserve(provider);
+				++reserved;
+			}
+
+			if ((*itr)->notBefore <= now && ((*itr)->bReserved || provider.empty()))
+			{
+				reserved -= (*itr)->bReserved ? 1 : 0;
+				starting.push_back(std::move(*itr));
+				itr = pending.erase(itr);
+			}
+			else
+			{
+				++itr;
+			}
+		}
+
+		for (auto& transfer : starting)
+			delivered += start(std::move(transfer), onComplete) ? 1 : 0;
+
+		int running = 0;
+		curl_multi_perform(multi, &running);
+
+		int queued = 0;
+		while (CURLMsg* msg = curl_multi_info_read(multi, &queued))
+		{
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+
+			CURL* easy = msg->easy_handle;
+			CURLcode res = msg->data.result;
+			_TRANSFER* done = nullptr;
+			curl_easy_getinfo(easy, CURLINFO_PRIVATE, &done);
+			curl_multi_remove_handle(multi, easy);
+
+			auto itr = std::find_if(active.begin(), active.end(), [done](const unique_ptr<_TRANSFER>& t) { return t.get() == done; });
+			if (itr == active.end())
+				continue;
+
+			unique_ptr<_TRANSFER> transfer = std::move(*itr);
+			active.erase(itr);
+
+			long http_code = 0;
+			curl_off_t retryAfter = 0;
+			curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_code);
+			curl_easy_getinfo(easy, CURLINFO_RETRY_AFTER, &retryAfter);
+			idleHandles.push_back(easy);
+			transfer->easy = nullptr;
+
+			delivered += finish(std::move(transfer), res, http_code, static_cast<long long>(retryAfter), onComplete) ? 1 : 0;
+		}
+
+		// replayed transfers complete once their latency has passed
+		auto nextReplay = steady_clock::time_point::max();
+		now = steady_clock::now();
+		for (size_t i = 0; i < active.size();)
+		{
+			if (active[i]->easy || active[i]->notBefore > now)
+			{
+				if (!active[i]->easy)
+					nextReplay = std::min(nextReplay, active[i]->notBefore);
+				++i;
+				continue;
+			}
+
+			unique_ptr<_TRANSFER> transfer = std::move(active[i]);
+			active.erase(active.begin() + i);
+
+			long http_code = 0;
+			cassette.replay(transfer->url, http_code, transfer->body);
+			delivered += finish(std::move(transfer), CURLE_OK, http_code, 0, onComplete) ? 1 : 0;
+		}
+
+		int timeoutMs = !active.empty() ? 100 : 50;
+		if (nextReplay != steady_clock::time_point::max())
+			timeoutMs = static_cast<int>(std::clamp<long long>(duration_cast<milliseconds>(nextReplay - steady_clock::now()).count(), 0, timeoutMs));
+
+		if (!active.empty() || !pending.empty())
+			curl_multi_poll(multi, nullptr, 0, timeoutMs, nullptr);
+	}
+
+	return delivered;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+#include <curl/curl.h>
+
+struct _DOWNLOAD_RESULT
+{
+	std::string url;
+	size_t tag;			// caller supplied request identifier
+	long httpCode;
+	CURLcode curlCode;
+	std::string body;
+};
+
+using DownloadCallback = std::function<void(_DOWNLOAD_RESULT& result)>;
+
+// Reusable receive buffers. Each endpoint (URL without its query) remembers how large its responses have
+// been, so a buffer handed out for it is already reserved to that size and never regrows while receiving.
+class BufferPool
+{
+public:
+	explicit BufferPool(size_t maxPooled = 32) : maxPooled(maxPooled) {}
+
+	std::string acquire(const std::string& endpoint);
+	void recordSize(const std::string& endpoint, size_t size);
+	void release(std::string&& buffer);
+
+	// hands <buffer> on as a shared read-only string that returns to the pool once the last reference is gone
+	std::shared_ptr<const std::string> share(std::string&& buffer);
+
+	static std::string endpointOf(const std::string& url);
+
+private:
+	std::mutex lock;
+	size_t maxPooled;
+	std::vector<std::string> buffers;
+	std::map<std::string, size_t> sizeHints;
+};
+
+BufferPool& getBufferPool();
+
+// Accept-Encoding for every transfer: "" lets libcurl offer every encoding it was built with (gzip,
+// deflate, br, zstd) and decode while streaming, so callbacks always receive plain text
+constexpr const char* AcceptAnyEncoding = "";
+
+// Concurrent HTTP engine on the libcurl multi interface. Up to maxInFlight transfers run at once, all
+// handles share the connection cache, DNS cache and TLS sessions, and each response is handed to the
+// callback as soon as it completes. Responses are requested compressed and every transfer receives into
+// its own buffer drawn from the BufferPool. Transfers are started as the provider's token bucket allows, and
+// 429 and transport errors are retried with backoff without blocking the other transfers. With a replaying
+// Cassette the responses come from the recording after the configured latency, no network is used.
+class DownloadEngine
+{
+public:
+	// provider selects the RateScheduler token bucket that paces the requests, empty means unpaced
+	explicit DownloadEngine(size_t maxInFlight = 8, const std::string& provider = std::string(), int maxRetries = 6);
+	~DownloadEngine();
+
+	DownloadEngine(const DownloadEngine&) = delete;
+	DownloadEngine& operator=(const DownloadEngine&) = delete;
+
+	void add(const std::string& url, size_t tag);
+
+	// runs until every queued request completed or ran out of retries, returns the number delivered
+	size_t run(const DownloadCallback& onComplete);
+
+private:
+	struct _TRANSFER
+	{
+		std::string url;
+		size_t tag;
+		int attempt;
+		bool bReserved;
+		std::chrono::steady_clock::time_point notBefore;
+		std::string endpoint;
+		std::string body;
+		CURL* easy;			// nullptr while served from a replayed cassette
+	};
+
+	CURL* acquireHandle();
+	bool start(std::unique_ptr<_TRANSFER> transfer, const DownloadCallback& onComplete);
+	bool finish(std::unique_ptr<_TRANSFER> transfer, CURLcode res, long httpCode, long long retryAfter, const DownloadCallback& onComplete);
+
+	CURLM* multi;
+	CURLSH* share;
+	size_t maxInFlight;
+	std::string provider;
+	int maxRetries;
+
+	std::deque<std::unique_ptr<_TRANSFER>> pending;
+	std::vector<std::unique_ptr<_TRANSFER>> active;
+	std::vector<CURL*> idleHandles;
+};
@@ -0,0 +1,314 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "Stock.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// TickerTape() with its configuration fixed at compile time: the top N symbols by volume over the last
+// WindowSeconds, counted in buckets of BucketSeconds, for at most MaxSymbols distinct symbols.
+//
+// All state lives inline in the object, sized by constexpr bucket and table counts, and nothing is
+// allocated after construction; give the engine static storage, it is too large for a stack. Per
+// symbol there is a running total plus a ring of bucket volumes laid out [slot][symbol], so
+//
+//   a trade        is one hash probe and three adds
+//   a new bucket   subtracts one contiguous row from the totals and clears it, a loop with no branches
+//   ranking        is one pass over the totals that touches the top N array only for a new contender
+//
+// The window is the newest bucket and the Buckets - 1 before it, so it reaches WindowSeconds back to
+// the bucket resolution rather than to the trade. Symbols are keyed on their first FixedSymbolLength
+// characters, like the binary stream framing; once MaxSymbols symbols were seen new ones are dropped.
+// Symbols stay in the table after their trades leave the window.
+//
+// The configuration the engine runs with (/Engine=fixed) is LiveTickerTape below, set at build time.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+constexpr size_t FixedSymbolLength = 8;
+
+template <size_t N, size_t WindowSeconds, size_t BucketSeconds, size_t MaxSymbols = 4096>
+class FixedTickerTape
+{
+public:
+	static_assert(N > 0 && N <= MaxSymbols, "the top list cannot be longer than the symbol table");
+	static_assert(BucketSeconds > 0 && WindowSeconds % BucketSeconds == 0, "the window must be a whole number of buckets");
+	static_assert(WindowSeconds / BucketSeconds > 0, "the window needs at least one bucket");
+	static_assert(MaxSymbols < UINT32_MAX, "symbol indices are 32 bit");
+
+	static constexpr size_t TopCount = N;
+	static constexpr size_t Buckets = WindowSeconds / BucketSeconds;
+	static constexpr int WindowMinutes = static_cast<int>((WindowSeconds + 59) / 60);
+
+	using RankedArray = std::array<_RANKED_STOCK, N>;
+
+	FixedTickerTape() { clear(); }
+
+	FixedTickerTape(const FixedTickerTape&) = delete;
+	FixedTickerTape& operator=(const FixedTickerTape&) = delete;
+
+	void clear()
+	{
+		std::memset(table, 0, sizeof(table));
+		std::memset(totals, 0, sizeof(totals));
+		std::memset(counts, 0, sizeof(counts));
+		std::memset(volumes, 0, sizeof(volumes));
+		std::memset(tradeCounts, 0, sizeof(tradeCounts));
+		head = LLONG_MIN;
+		used = 0;
+		rankedCount = 0;
+		droppedCount = 0;
+	}
+
+	// false when the trade is older than the window or its symbol does not fit in the table
+	bool onTrade(std::string_view symbol, int shares, const TimePoint& transTime)
+	{
+		const long long bucket = bucketOf(transTime);
+		if (bucket > head)
+			advanceToBucket(bucket);
+
+		if (bucket <= head - static_cast<long long>(Buckets))
+		{
+			++droppedCount;
+			return false;
+		}
+
+		const size_t s = findOrAdd(packSymbol(symbol));
+		if (s == MaxSymbols)
+		{
+			++droppedCount;
+			return false;
+		}
+
+		const size_t slot = slotOf(bucket);
+		volumes[slot][s] += shares;
+		tradeCounts[slot][s] += 1;
+		totals[s] += shares;
+		counts[s] += 1;
+
+		const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(transTime.time_since_epoch()).count();
+		lastTradeNs[s] = ns > lastTradeNs[s] ? ns : lastTradeNs[s];
+		return true;
+	}
+
+	void onTrades(const TradeStructVector& trades)
+	{
+		for (const auto& trade : trades)
+			onTrade(trade.stkSym, trade.numShares, trade.transTime);
+	}
+
+	// moves the window to end at <now>, expiring the buckets that fall out of it
+	void advanceTo(const TimePoint& now)
+	{
+		const long long bucket = bucketOf(now);
+		if (bucket > head)
+			advanceToBucket(bucket);
+	}
+
+	// ranks the symbols in the window by volume into top(), returns how many there are (at most N)
+	size_t rank()
+	{
+		uint32_t index[N];
+		long long volume[N];
+		size_t n = 0;
+
+		for (size_t s = 0; s < used; ++s)
+		{
+			const long long v = totals[s];
+			if (v <= 0 || (n == N && v <= volume[N - 1]))
+				continue;
+
+			// insertion into the sorted list; ties keep the symbol seen first ahead
+			size_t pos = n < N ? n++ : N - 1;
+			for (; pos > 0 && volume[pos - 1] < v; --pos)
+			{
+				volume[pos] = volume[pos - 1];
+				index[pos] = index[pos - 1];
+			}
+			volume[pos] = v;
+			index[pos] = static_cast<uint32_t>(s);
+		}
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			const size_t s = index[i];
+			_RANKED_STOCK& stock = ranked[i];
+
+			std::memset(stock.stkSym, 0, sizeof(stock.stkSym));
+			std::memcpy(stock.stkSym, &keys[s], FixedSymbolLength);
+			stock.totalShares = volume[i];
+			stock.tradeCount = counts[s];
+			stock.lastTrade = TimePoint(std::chrono::duration_cast<TimePoint::duration>(std::chrono::nanoseconds(lastTradeNs[s])));
+
+			// first trade to the bucket: start of the oldest bucket the symbol traded in
+			stock.firstTrade = stock.lastTrade;
+			for (long long b = head - static_cast<long long>(Buckets) + 1; b <= head; ++b)
+			{
+				if (tradeCounts[slotOf(b)][s] != 0)
+				{
+					stock.firstTrade = TimePoint(std::chrono::seconds(b * static_cast<long long>(BucketSeconds)));
+					break;
+				}
+			}
+		}
+
+		rankedCount = n;
+		return n;
+	}
+
+	// the list made by the last rank()
+	const RankedArray& top() const { return ranked; }
+	size_t topSize() const { return rankedCount; }
+
+	// shares traded by <symbol> inside the window
+	long long volume(std::string_view symbol) const
+	{
+		const size_t s = find(packSymbol(symbol));
+		return s == MaxSymbols ? 0 : totals[s];
+	}
+
+	size_t symbols() const { return used; }
+	size_t dropped() const { return droppedCount; }
+
+private:
+	static constexpr size_t tableSizeFor(size_t n)
+	{
+		size_t size = 1;
+		while (size < n)
+			size <<= 1;
+		return size;
+	}
+
+	// open addressing at a load factor of at most one half
+	static constexpr size_t TableSize = tableSizeFor(MaxSymbols * 2);
+	static constexpr size_t TableMask = TableSize - 1;
+
+	static uint64_t packSymbol(std::string_view symbol)
+	{
+		uint64_t key = 0;
+		std::memcpy(&key, symbol.data(), symbol.size() < FixedSymbolLength ? symbol.size() : FixedSymbolLength);
+		return key;
+	}
+
+	static size_t hashOf(uint64_t key)
+	{
+		return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & TableMask;
+	}
+
+	static long long bucketOf(const TimePoint& t)
+	{
+		const long long seconds = std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch()).count();
+		const long long width = static_cast<long long>(BucketSeconds);
+		return seconds >= 0 ? seconds / width : (seconds - width + 1) / width;
+	}
+
+	static size_t slotOf(long long bucket)
+	{
+		const long long r = bucket % static_cast<long long>(Buckets);
+		return static_cast<size_t>(r < 0 ? r + static_cast<long long>(Buckets) : r);
+	}
+
+	size_t find(uint64_t key) const
+	{
+		for (size_t h = hashOf(key);; h = (h + 1) & TableMask)
+		{
+			if (table[h] == 0)
+				return MaxSymbols;
+			if (keys[table[h] - 1] == key)
+				return table[h] - 1;
+		}
+	}
+
+	size_t findOrAdd(uint64_t key)
+	{
+		size_t h = hashOf(key);
+		for (; table[h] != 0; h = (h + 1) & TableMask)
+		{
+			if (keys[table[h] - 1] == key)
+				return table[h] - 1;
+		}
+
+		if (used == MaxSymbols)
+			return MaxSymbols;
+
+		keys[used] = key;
+		lastTradeNs[used] = LLONG_MIN;
+		table[h] = static_cast<uint32_t>(++used);
+		return used - 1;
+	}
+
+	void expire(size_t slot)
+	{
+		long long* volumeRow = volumes[slot];
+		uint32_t* countRow = tradeCounts[slot];
+
+		for (size_t s = 0; s < used; ++s)
+		{
+			totals[s] -= volumeRow[s];
+			counts[s] -= countRow[s];
+		}
+
+		std::memset(volumeRow, 0, used * sizeof(long long));
+		std::memset(countRow, 0, used * sizeof(uint32_t));
+	}
+
+	void advanceToBucket(long long bucket)
+	{
+		if (head != LLONG_MIN && bucket - head < static_cast<long long>(Buckets))
+		{
+			for (long long b = head + 1; b <= bucket; ++b)
+				expire(slotOf(b));
+		}
+		else
+		{
+			// the whole window is new
+			for (size_t slot = 0; slot < Buckets; ++slot)
+			{
+				std::memset(volumes[slot], 0, used * sizeof(long long));
+				std::memset(tradeCounts[slot], 0, used * sizeof(uint32_t));
+			}
+			std::memset(totals, 0, used * sizeof(long long));
+			std::memset(counts, 0, used * sizeof(uint32_t));
+		}
+
+		head = bucket;
+	}
+
+	long long head;								// newest bucket of the window, in BucketSeconds since the epoch
+	size_t used;								// symbols in the table, indices 0 .. used - 1
+	size_t rankedCount;
+	size_t droppedCount;
+
+	uint32_t table[TableSize];					// symbol index + 1, 0 = empty
+	uint64_t keys[MaxSymbols];
+	long long totals[MaxSymbols];				// shares inside the window
+	uint32_t counts[MaxSymbols];				// trades inside the window
+	int64_t lastTradeNs[MaxSymbols];
+
+	alignas(64) long long volumes[Buckets][MaxSymbols];
+	alignas(64) uint32_t tradeCounts[Buckets][MaxSymbols];
+
+	RankedArray ranked;
+};
+
+// build time configuration of the engine /Engine=fixed runs, e.g. /DTICKER_TAPE_MAX_SYMBOLS=8192
+#ifndef TICKER_TAPE_TOP_N
+#define TICKER_TAPE_TOP_N 50
+#endif
+
+#ifndef TICKER_TAPE_WINDOW_SECONDS
+#define TICKER_TAPE_WINDOW_SECONDS 300
+#endif
+
+#ifndef TICKER_TAPE_BUCKET_SECONDS
+#define TICKER_TAPE_BUCKET_SECONDS 15
+#endif
+
+#ifndef TICKER_TAPE_MAX_SYMBOLS
+#define TICKER_TAPE_MAX_SYMBOLS 4096
+#endif
+
+using LiveTickerTape = FixedTickerTape<TICKER_TAPE_TOP_N, TICKER_TAPE_WINDOW_SECONDS, TICKER_TAPE_BUCKET_SECONDS, TICKER_TAPE_MAX_SYMBOLS>;
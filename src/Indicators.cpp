@@ -0,0 +1,250 @@
+#include <cmath>
+#include <algorithm>
+
+#include "Indicators.h"
+
+using namespace std;
+using namespace std::chrono;
+
+static long long minuteOf(const TimePoint& time)
+{
+	long long seconds = duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+	return seconds >= 0 ? seconds / 60 : (seconds - 59) / 60;
+}
+
+
+IndicatorEngine::IndicatorEngine(size_t windowBars, size_t emaPeriod)
+	: window(std::max<size_t>(windowBars, 2)), alpha(2.0 / (static_cast<double>(std::max<size_t>(emaPeriod, 1)) + 1.0))
+{
+}
+
+
+size_t IndicatorEngine::indexOf(const string& symbol)
+{
+	auto itr = index.find(symbol);
+	if (itr != index.end())
+		return itr->second;
+
+	if (count == capacity)
+		grow();
+
+	index.emplace(symbol, count);
+	return count++;
+}
+
+
+// doubles the symbol capacity; the rings are re-laid out because their row stride is the capacity
+void IndicatorEngine::grow()
+{
+	const size_t oldCapacity = capacity;
+	capacity = std::max<size_t>(capacity * 2, 64);
+
+	for (auto* field : { &lastPrice, &priced, &minuteVolume, &minutePV, &bars, &lastVolume, &ema,
+		&sumClose, &sumClose2, &sumVolume, &sumVolume2, &sumPV })
+		field->resize(capacity, 0.0);
+
+	for (auto* ring : { &ringClose, &ringVolume, &ringPV })
+	{
+		vector<double> relaid(window * capacity, 0.0);
+		for (size_t slot = 0; slot < window && oldCapacity > 0; ++slot)
+			std::copy_n(ring->data() + slot * oldCapacity, oldCapacity, relaid.data() + slot * capacity);
+		ring->swap(relaid);
+	}
+}
+
+
+void IndicatorEngine::onTrade(const string& symbol, double price, long long shares, const TimePoint& time)
+{
+	advanceToMinute(minuteOf(time));
+
+	const size_t i = indexOf(symbol);
+	if (price > 0.0)
+	{
+		lastPrice[i] = price;
+		priced[i] = 1.0;
+	}
+
+	minuteVolume[i] += static_cast<double>(shares);
+	minutePV[i] += lastPrice[i] * static_cast<double>(shares);
+}
+
+
+void IndicatorEngine::onTrades(const TradeStructVector& trades)
+{
+	for (const auto& trade : trades)
+		onTrade(trade.stkSym, trade.price, trade.numShares, trade.transTime);
+}
+
+
+void IndicatorEngine::onBar(const string& symbol, const _BAR& bar)
+{
+	long long minute = bar.timestamp >= 0 ? bar.timestamp / 60 : (bar.timestamp - 59) / 60;
+	advanceToMinute(minute);
+
+	const size_t i = indexOf(symbol);
+	lastPrice[i] = bar.close;
+	priced[i] = 1.0;
+
+	// the bar's typical price stands in for its trades
+	minuteVolume[i] += static_cast<double>(bar.volume);
+	minutePV[i] += (bar.high + bar.low + bar.close) / 3.0 * static_cast<double>(bar.volume);
+}
+
+
+void IndicatorEngine::advanceTo(const TimePoint& time)
+{
+	advanceToMinute(minuteOf(time));
+}
+
+
+void IndicatorEngine::advanceToMinute(long long minute)
+{
+	if (currentMinute == LLONG_MIN)
+	{
+		currentMinute = minute;
+		return;
+	}
+
+	// late arrivals are counted in the current minute
+	if (minute <= currentMinute)
+		return;
+
+	const long long gap = minute - currentMinute;
+	const long long steps = std::min<long long>(gap, static_cast<long long>(window));
+
+	for (long long s = 0; s < steps; ++s)
+		closeMinute();
+
+	// after a whole window without trades the rings only hold the carried closes; the rest of the gap
+	// just pulls the EMA further towards them, which is done in closed form
+	if (gap > steps)
+	{
+		const double decay = std::pow(1.0 - alpha, static_cast<double>(gap - steps));
+		for (size_t i = 0; i < count; ++i)
+		{
+			ema[i] = lastPrice[i] + (ema[i] - lastPrice[i]) * decay;
+			bars[i] += priced[i] * static_cast<double>(gap - steps);
+		}
+		closed += static_cast<size_t>(gap - steps);
+	}
+
+	currentMinute = minute;
+}
+
+
+// Column kernels. Each one streams a few contiguous arrays with restrict parameters, so the compiler
+// can vectorize without runtime alias checks.
+
+// x = value * mask replaces ring in the window: sum += x - ring, sum2 += x^2 - ring^2, ring = x
+template <bool bSquares>
+static void rollColumn(size_t n, const double* __restrict value, const double* __restrict mask,
+	double* __restrict ring, double* __restrict sum, double* __restrict sum2)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		const double x = value[i] * mask[i];
+		sum[i] += x - ring[i];
+		if constexpr (bSquares)
+			sum2[i] += x * x - ring[i] * ring[i];
+		ring[i] = x;
+	}
+}
+
+
+// the first bar of a symbol seeds its EMA
+static void updateEma(size_t n, double alpha, const double* __restrict close, const double* __restrict mask,
+	double* __restrict ema, double* __restrict bars)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		ema[i] = bars[i] > 0.0 ? ema[i] + alpha * (close[i] - ema[i]) : close[i];
+		bars[i] += mask[i];
+	}
+}
+
+
+template <bool bSquares>
+static void sumColumn(size_t n, const double* __restrict ring, double* __restrict sum, double* __restrict sum2)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		sum[i] += ring[i];
+		if constexpr (bSquares)
+			sum2[i] += ring[i] * ring[i];
+	}
+}
+
+
+// closes the current minute for every symbol; unpriced symbols contribute zeros until their first priced trade
+void IndicatorEngine::closeMinute()
+{
+	const size_t n = count;
+	double* rc = ringClose.data() + head * capacity;
+	double* rv = ringVolume.data() + head * capacity;
+	double* rpv = ringPV.data() + head * capacity;
+
+	rollColumn<true>(n, lastPrice.data(), priced.data(), rc, sumClose.data(), sumClose2.data());
+	rollColumn<true>(n, minuteVolume.data(), priced.data(), rv, sumVolume.data(), sumVolume2.data());
+	rollColumn<false>(n, minutePV.data(), priced.data(), rpv, sumPV.data(), nullptr);
+	updateEma(n, alpha, rc, priced.data(), ema.data(), bars.data());
+
+	std::copy_n(rv, n, lastVolume.begin());
+	std::fill_n(minuteVolume.begin(), n, 0.0);
+	std::fill_n(minutePV.begin(), n, 0.0);
+
+	++closed;
+	if (++head == window)
+	{
+		head = 0;
+		rebuildSums();
+	}
+}
+
+
+// recomputes the rolling sums from the rings, once per window so the cost per bar stays O(1)
+void IndicatorEngine::rebuildSums()
+{
+	const size_t n = count;
+
+	for (auto* sum : { &sumClose, &sumClose2, &sumVolume, &sumVolume2, &sumPV })
+		std::fill_n(sum->begin(), n, 0.0);
+
+	for (size_t slot = 0; slot < window; ++slot)
+	{
+		sumColumn<true>(n, ringClose.data() + slot * capacity, sumClose.data(), sumClose2.data());
+		sumColumn<true>(n, ringVolume.data() + slot * capacity, sumVolume.data(), sumVolume2.data());
+		sumColumn<false>(n, ringPV.data() + slot * capacity, sumPV.data(), nullptr);
+	}
+}
+
+
+bool IndicatorEngine::get(const string& symbol, _INDICATOR_VALUES& values) const
+{
+	values = _INDICATOR_VALUES{ NAN, NAN, NAN, NAN };
+
+	auto itr = index.find(symbol);
+	if (itr == index.end())
+		return false;
+
+	const size_t i = itr->second;
+	const double n = std::min(bars[i], static_cast<double>(window));
+	if (n < 1.0)
+		return true;
+
+	values.ema = ema[i];
+
+	if (sumVolume[i] > 0.0)
+		values.vwap = sumPV[i] / sumVolume[i];
+
+	if (n >= 2.0)
+	{
+		const double mean = sumClose[i] / n;
+		values.stdDev = std::sqrt(std::max(0.0, sumClose2[i] / n - mean * mean));
+
+		const double meanVolume = sumVolume[i] / n;
+		const double varVolume = sumVolume2[i] / n - meanVolume * meanVolume;
+		values.zVolume = varVolume > 0.0 ? (lastVolume[i] - meanVolume) / std::sqrt(varVolume) : 0.0;
+	}
+
+	return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <climits>
+
+#include "Stock.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Rolling indicators over 1 minute bars, kept up to date in O(1) per bar instead of walking the window:
+//
+//   EMA       exponential moving average of the close, alpha = 2 / (period + 1)
+//   VWAP      sum(price * volume) / sum(volume) over the window
+//   StdDev    population standard deviation of the close over the window
+//   ZVolume   (last bar's volume - mean volume) / stddev of volume over the window
+//
+// Trades (live ingest, replay) or bars are accumulated into the current minute. When a later minute
+// arrives the minute is closed for every symbol at once: symbols that did not trade repeat their last
+// close with no volume, so all symbols advance in lock step and share one ring position.
+//
+// State is one structure of arrays across all symbols, the rings are laid out [slot][symbol]. Closing a
+// minute is then a single branch free loop over contiguous arrays that the compiler vectorizes: each
+// rolling sum adds the new value and subtracts the one leaving the window. The sums are rebuilt from the
+// rings every time the ring wraps, so rounding errors cannot accumulate (amortized O(1) per bar).
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+struct _INDICATOR_VALUES
+{
+	double ema;
+	double vwap;
+	double stdDev;
+	double zVolume;
+};
+
+class IndicatorEngine
+{
+public:
+	explicit IndicatorEngine(size_t windowBars = 20, size_t emaPeriod = 20);
+
+	void onTrade(const std::string& symbol, double price, long long shares, const TimePoint& time);
+	void onTrades(const TradeStructVector& trades);
+
+	// one finished bar of <symbol>, timestamp in UTC epoch seconds
+	void onBar(const std::string& symbol, const _BAR& bar);
+
+	// closes every minute before <time>
+	void advanceTo(const TimePoint& time);
+
+	// values of the closed minutes, NaN until the symbol has enough bars
+	bool get(const std::string& symbol, _INDICATOR_VALUES& values) const;
+
+	size_t symbols() const { return count; }
+	size_t closedMinutes() const { return closed; }
+
+private:
+	size_t indexOf(const std::string& symbol);
+	void advanceToMinute(long long minute);
+	void closeMinute();
+	void grow();
+	void rebuildSums();
+
+	size_t window;
+	double alpha;
+
+	std::unordered_map<std::string, size_t> index;
+	size_t count = 0;
+	size_t capacity = 0;
+
+	long long currentMinute = LLONG_MIN;	// minutes since the epoch being accumulated
+	size_t head = 0;						// ring slot of the current minute
+	size_t closed = 0;
+
+	// per symbol [capacity]
+	std::vector<double> lastPrice;			// 0 until the first priced trade
+	std::vector<double> priced;				// 1 once lastPrice is known, used as a mask
+	std::vector<double> minuteVolume;
+	std::vector<double> minutePV;
+	std::vector<double> bars;				// closed bars since the symbol was priced
+	std::vector<double> lastVolume;
+	std::vector<double> ema;
+	std::vector<double> sumClose;
+	std::vector<double> sumClose2;
+	std::vector<double> sumVolume;
+	std::vector<double> sumVolume2;
+	std::vector<double> sumPV;
+
+	// [window * capacity], slot major
+	std::vector<double> ringClose;
+	std::vector<double> ringVolume;
+	std::vector<double> ringPV;
+};
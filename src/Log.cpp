@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <algorithm>
+
+#include "Log.h"
+
+using namespace std;
+
+static size_t roundUpToPowerOfTwo(size_t n)
+{
+	size_t p = 2;
+	while (p < n)
+		p <<= 1;
+	return p;
+}
+
+
+Logger::Logger(size_t capacity)
+{
+	size_t size = roundUpToPowerOfTwo(capacity);
+	slots = make_unique<_SLOT[]>(size);
+	mask = size - 1;
+
+	for (size_t i = 0; i < size; ++i)
+		slots[i].sequence.store(i, memory_order_relaxed);
+
+	sink = thread(&Logger::sinkLoop, this);
+}
+
+
+Logger::~Logger()
+{
+	bStop.store(true);
+	signal.fetch_add(1, memory_order_release);
+	signal.notify_one();
+
+	if (sink.joinable())
+		sink.join();
+}
+
+
+bool Logger::tryPush(LogLevel level, string& text)
+{
+	size_t pos = head.load(memory_order_relaxed);
+
+	for (;;)
+	{
+		_SLOT& slot = slots[pos & mask];
+		size_t sequence = slot.sequence.load(memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+		if (diff == 0)
+		{
+			if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+			{
+				slot.level = level;
+				slot.text = std::move(text);
+				slot.sequence.store(pos + 1, memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0)
+		{
+			// the consumer has not freed this slot yet, the ring is full
+			return false;
+		}
+		else
+		{
+			pos = head.load(memory_order_relaxed);
+		}
+	}
+}
+
+
+// only called from the sink thread
+bool Logger::tryPop(LogLevel& level, string& text)
+{
+	_SLOT& slot = slots[tail & mask];
+	if (slot.sequence.load(memory_order_acquire) != tail + 1)
+		return false;
+
+	level = slot.level;
+	text = std::move(slot.text);
+	slot.text.clear();
+	slot.sequence.store(tail + mask + 1, memory_order_release);
+	++tail;
+
+	return true;
+}
+
+
+void Logger::write(LogLevel level, string&& text)
+{
+	if (!text.empty() && text.back() == '\n')
+		text.pop_back();
+
+	while (!tryPush(level, text))
+	{
+		if (level == LogLevel::Debug)
+		{
+			droppedCount.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+
+		this_thread::yield();
+	}
+
+	signal.fetch_add(1, memory_order_release);
+	signal.notify_one();
+}
+
+
+void Logger::flush()
+{
+	const size_t target = head.load(memory_order_acquire);
+
+	size_t done = written.load(memory_order_acquire);
+	while (done < target)
+	{
+		written.wait(done, memory_order_acquire);
+		done = written.load(memory_order_acquire);
+	}
+}
+
+
+void Logger::sinkLoop()
+{
+	static const char* prefixes[] = { "[debug] ", "", "warning: ", "error: " };
+
+	string outBuffer;
+	string errBuffer;
+	string text;
+	LogLevel level = LogLevel::Info;
+
+	for (;;)
+	{
+		uint32_t observed = signal.load(memory_order_acquire);
+
+		// batch everything that is queued into one write per stream
+		size_t count = 0;
+		while (tryPop(level, text))
+		{
+			string& out = level >= LogLevel::Warning || bStderrOnly.load(memory_order_relaxed) ? errBuffer : outBuffer;
+			out += prefixes[static_cast<int>(level)];
+			out += text;
+			out += '\n';
+			++count;
+
+			if (outBuffer.size() + errBuffer.size() >= (256u << 10))
+				break;
+		}
+
+		if (!outBuffer.empty())
+		{
+			fwrite(outBuffer.data(), 1, outBuffer.size(), stdout);
+			fflush(stdout);
+			outBuffer.clear();
+		}
+
+		if (!errBuffer.empty())
+		{
+			fwrite(errBuffer.data(), 1, errBuffer.size(), stderr);
+			fflush(stderr);
+			errBuffer.clear();
+		}
+
+		if (count > 0)
+		{
+			written.store(tail, memory_order_release);
+			written.notify_all();
+			continue;
+		}
+
+		if (bStop.load())
+			break;
+
+		signal.wait(observed, memory_order_acquire);
+	}
+
+	if (size_t lost = droppedCount.load())
+		fprintf(stderr, "%zu debug log line(s) dropped\n", lost);
+}
+
+
+Logger& getLogger()
+{
+	static Logger logger;
+	return logger;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <cstdint>
+
+enum class LogLevel { Debug, Info, Warning, Error, Off };
+
+// Leveled console logger. Callers format a line and hand it to a bounded lock-free ring (Vyukov's
+// MPMC array queue, drained by a single consumer); a background thread writes the lines out, Debug and
+// Info to stdout, Warning and Error to stderr. A full ring drops Debug lines and makes every other level
+// wait for room, so nothing that matters is lost.
+class Logger
+{
+public:
+	explicit Logger(size_t capacity = 8192);
+	~Logger();
+
+	Logger(const Logger&) = delete;
+	Logger& operator=(const Logger&) = delete;
+
+	void setLevel(LogLevel level) { minLevel.store(level, std::memory_order_relaxed); }
+	LogLevel getLevel() const { return minLevel.load(std::memory_order_relaxed); }
+	bool enabled(LogLevel level) const { return level >= getLevel() && level != LogLevel::Off; }
+
+	// keep stdout clean when it carries data, e.g. a trade stream
+	void setStderrOnly(bool bOnly) { bStderrOnly.store(bOnly, std::memory_order_relaxed); }
+
+	void write(LogLevel level, std::string&& text);
+
+	// block until every line queued so far has reached the console
+	void flush();
+
+	size_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+
+private:
+	struct _SLOT
+	{
+		std::atomic<size_t> sequence;
+		LogLevel level;
+		std::string text;
+	};
+
+	bool tryPush(LogLevel level, std::string& text);
+	bool tryPop(LogLevel& level, std::string& text);
+	void sinkLoop();
+
+	std::unique_ptr<_SLOT[]> slots;
+	size_t mask;
+
+	alignas(64) std::atomic<size_t> head{ 0 };
+	alignas(64) size_t tail = 0;
+	alignas(64) std::atomic<size_t> written{ 0 };
+	std::atomic<uint32_t> signal{ 0 };
+	std::atomic<size_t> droppedCount{ 0 };
+	std::atomic<LogLevel> minLevel{ LogLevel::Info };
+	std::atomic<bool> bStop{ false };
+	std::atomic<bool> bStderrOnly{ false };
+
+	std::thread sink;
+};
+
+Logger& getLogger();
+
+
+// One log line, formatted with operator<< and queued when it goes out of scope.
+class LogLine
+{
+public:
+	explicit LogLine(LogLevel level) : level(level) {}
+	~LogLine() { getLogger().write(level, stream.str()); }
+
+	template <typename T>
+	LogLine& operator<<(const T& value)
+	{
+		stream << value;
+		return *this;
+	}
+
+	LogLine& operator<<(std::ostream& (*manip)(std::ostream&))
+	{
+		stream << manip;
+		return *this;
+	}
+
+private:
+	LogLevel level;
+	std::ostringstream stream;
+};
+
+// turns the LogLine expression into void, operator& binds looser than operator<<
+struct _LOG_VOIDIFY
+{
+	void operator&(const LogLine&) {}
+};
+
+// The arguments are only evaluated when the level is enabled, so a disabled LOG_DEBUG << payload costs a load.
+#define LOG(level) !getLogger().enabled(level) ? (void)0 : _LOG_VOIDIFY() & LogLine(level)
+#define LOG_DEBUG LOG(LogLevel::Debug)
+#define LOG_INFO LOG(LogLevel::Info)
+#define LOG_WARNING LOG(LogLevel::Warning)
+#define LOG_ERROR LOG(LogLevel::Error)
@@ -0,0 +1,141 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+
+#include "Manifest.h"
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+// one partition per line: symbol,date,interval,rows,bytes,checksum,complete,csvFilename
+static const string ManifestHeader = "symbol,date,interval,rows,bytes,checksum,complete,filename";
+
+
+string PartitionManifest::keyOf(const string& symbol, const string& date, const string& interval)
+{
+	return symbol + '|' + date + '|' + interval;
+}
+
+
+unsigned long long PartitionManifest::checksum(const string& data)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned char c : data)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+
+bool PartitionManifest::load(const string& manifestFilename)
+{
+	filename = manifestFilename;
+	partitions.clear();
+
+	ifstream inFile(filename);
+	if (!inFile.is_open())
+		return false;
+
+	string txtLine;
+	while (getline(inFile, txtLine))
+	{
+		if (txtLine.empty() || txtLine == ManifestHeader)
+			continue;
+
+		_PARTITION_STATE state;
+		string rows, bytes, checksum, complete;
+		stringstream ss(txtLine);
+
+		if (!getline(ss, state.symbol, ',') || !getline(ss, state.date, ',') || !getline(ss, state.interval, ',') ||
+			!getline(ss, rows, ',') || !getline(ss, bytes, ',') || !getline(ss, checksum, ',') ||
+			!getline(ss, complete, ',') || !getline(ss, state.csvFilename))
+			continue;
+
+		try
+		{
+			state.rows = stoll(rows);
+			state.bytes = stoull(bytes);
+			state.checksum = stoull(checksum, nullptr, 16);
+			state.bComplete = complete == "1";
+		}
+		catch (...)
+		{
+			continue;
+		}
+
+		partitions[keyOf(state.symbol, state.date, state.interval)] = state;
+	}
+
+	return true;
+}
+
+
+bool PartitionManifest::save() const
+{
+	if (filename.empty())
+		return false;
+
+	std::error_code ec;
+	fs::create_directories(fs::path(filename).parent_path(), ec);
+
+	// written aside and renamed, a crash never leaves a truncated manifest behind
+	const string tmpFilename = filename + ".tmp";
+	{
+		ofstream outFile(tmpFilename, std::ios::trunc);
+		if (!outFile)
+			return false;
+
+		outFile << ManifestHeader << '\n';
+		for (const auto& partition : partitions)
+		{
+			const _PARTITION_STATE& state = partition.second;
+			char checksum[24];
+			snprintf(checksum, sizeof(checksum), "%016llx", state.checksum);
+
+			outFile << state.symbol << ',' << state.date << ',' << state.interval << ',' << state.rows << ',' << state.bytes << ','
+				<< checksum << ',' << (state.bComplete ? 1 : 0) << ',' << state.csvFilename << '\n';
+		}
+
+		if (!outFile)
+			return false;
+	}
+
+	fs::rename(tmpFilename, filename, ec);
+	return !ec;
+}
+
+
+bool PartitionManifest::isComplete(const string& symbol, const string& date, const string& interval) const
+{
+	auto itr = partitions.find(keyOf(symbol, date, interval));
+	if (itr == partitions.end() || !itr->second.bComplete)
+		return false;
+
+	// a file that was removed or rewritten outside the pipeline has to be fetched again; the size rules out
+	// most of them without reading the file
+	std::error_code ec;
+	auto size = fs::file_size(itr->second.csvFilename, ec);
+	if (ec || size != itr->second.bytes)
+		return false;
+
+	ifstream inFile(itr->second.csvFilename, ios::binary);
+	string header;
+	if (!getline(inFile, header))
+		return false;
+
+	// the checksum covers the rows after the header
+	string rows(static_cast<size_t>(size) - std::min<size_t>(header.size() + 1, static_cast<size_t>(size)), '\0');
+	inFile.read(rows.data(), static_cast<streamsize>(rows.size()));
+	return inFile.gcount() == static_cast<streamsize>(rows.size()) && checksum(rows) == itr->second.checksum;
+}
+
+
+void PartitionManifest::update(const _PARTITION_STATE& state)
+{
+	partitions[keyOf(state.symbol, state.date, state.interval)] = state;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <map>
+
+// State of one downloaded symbol/day/interval partition
+struct _PARTITION_STATE
+{
+	std::string symbol;
+	std::string date;						// yyyy-mm-dd
+	std::string interval;					// 1m
+	long long rows = 0;
+	unsigned long long bytes = 0;			// size of the CSV file including its header
+	unsigned long long checksum = 0;		// FNV-1a over the CSV rows
+	bool bComplete = false;					// false while the day's session may still grow
+	std::string csvFilename;
+};
+
+// Manifest of the Daily partitions already on disk, kept in <path>/Daily/partitions.manifest so cleaning
+// the Daily tree also forgets it. A partition counts as complete when it was fetched after its day ended,
+// even without rows, and its CSV file still has the recorded size and checksum.
+class PartitionManifest
+{
+public:
+	bool load(const std::string& filename);
+	bool save() const;
+
+	bool isComplete(const std::string& symbol, const std::string& date, const std::string& interval) const;
+	void update(const _PARTITION_STATE& state);
+
+	size_t size() const { return partitions.size(); }
+
+	static unsigned long long checksum(const std::string& data);
+
+private:
+	static std::string keyOf(const std::string& symbol, const std::string& date, const std::string& interval);
+
+	std::string filename;
+	std::map<std::string, _PARTITION_STATE> partitions;
+};
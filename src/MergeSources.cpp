@@ -0,0 +1,310 @@
+#include <fstream>
+#include <map>
+#include <set>
+#include <queue>
+#include <cmath>
+#include <algorithm>
+
+#include "MergeSources.h"
+#include "CsvBars.h"
+#include "Log.h"
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+// one symbol-day of one source
+struct _SOURCE_DAY
+{
+	fs::path csvFilename;
+	fs::file_time_type lastWrite;
+};
+
+// per symbol of the date being merged, the file of each source (empty path where the source has none)
+using SourceDayMap = map<string, vector<_SOURCE_DAY>>;
+
+// bars of one source for the symbol-day being merged
+struct _MERGE_CURSOR
+{
+	BarVector bars;
+	size_t pos = 0;
+	size_t source = 0;
+
+	bool done() const { return pos >= bars.size(); }
+	const _BAR& current() const { return bars[pos]; }
+};
+
+
+// names of the subfolders of all <parents>, ordered by their number (years, months) or name (dates)
+static vector<string> listFolderNames(const vector<fs::path>& parents, bool bNumeric)
+{
+	set<string> found;
+	std::error_code ec;
+
+	for (const auto& parent : parents)
+	{
+		for (fs::directory_iterator itr(parent, ec), end; !ec && itr != end; itr.increment(ec))
+		{
+			if (itr->is_directory(ec))
+				found.insert(itr->path().filename().string());
+		}
+	}
+
+	vector<string> names(found.begin(), found.end());
+	if (bNumeric)
+		std::stable_sort(names.begin(), names.end(), [](const string& a, const string& b) { return atoi(a.c_str()) < atoi(b.c_str()); });
+
+	return names;
+}
+
+
+// <SYM>_<yyyy-mm-dd>.csv files of one source's date folder
+static void addSourceDays(const fs::path& folder, size_t source, size_t sourceCount, SourceDayMap& days)
+{
+	std::error_code ec;
+	string symbol, date;
+
+	for (fs::directory_iterator itr(folder, ec), end; !ec && itr != end; itr.increment(ec))
+	{
+		if (!itr->is_regular_file(ec) || itr->path().extension() != ".csv")
+			continue;
+
+		if (!splitPartitionStem(itr->path().stem().string(), symbol, date) || date.size() != 10)
+			continue;
+
+		auto& files = days[symbol];
+		files.resize(sourceCount);
+		files[source] = _SOURCE_DAY{ itr->path(), itr->last_write_time(ec) };
+	}
+}
+
+
+// reads a partition, floors its timestamps to the minute and keeps the last bar of every minute
+static bool loadCursor(const fs::path& filename, _MERGE_CURSOR& cursor)
+{
+	cursor.bars.clear();
+	cursor.pos = 0;
+
+	bool lOK = readPartitionFile(filename, [&cursor](const _BAR& bar)
+	{
+		_BAR minute = bar;
+		long long r = minute.timestamp % 60;
+		minute.timestamp -= r < 0 ? r + 60 : r;
+		cursor.bars.push_back(minute);
+	});
+
+	if (!lOK)
+		return false;
+
+	auto& bars = cursor.bars;
+	std::stable_sort(bars.begin(), bars.end(), [](const _BAR& a, const _BAR& b) { return a.timestamp < b.timestamp; });
+
+	size_t out = 0;
+	for (size_t i = 0; i < bars.size(); ++i)
+	{
+		if (out > 0 && bars[out - 1].timestamp == bars[i].timestamp)
+			bars[out - 1] = bars[i];
+		else
+			bars[out++] = bars[i];
+	}
+	bars.resize(out);
+
+	return true;
+}
+
+
+static bool writeMergedDay(const fs::path& filename, const BarVector& bars)
+{
+	std::error_code ec;
+	fs::create_directories(filename.parent_path(), ec);
+
+	ofstream out(filename, ios::binary | ios::trunc);
+	if (!out)
+		return false;
+
+	string text(BarCsvHeader);
+	text.reserve(text.size() + bars.size() * 64);
+
+	for (const auto& bar : bars)
+		appendBarCSV(text, bar);
+
+	out.write(text.data(), text.size());
+	return out.good();
+}
+
+
+bool SourceMerger::run(const string& outputPath, _MERGE_STATS* stats) const
+{
+	_MERGE_STATS local;
+	_MERGE_STATS& result = stats ? *stats : local;
+	result = _MERGE_STATS();
+	result.won.assign(sources.size(), 0);
+
+	if (sources.empty())
+		return true;
+
+	bool lOK = true;
+	std::error_code ec;
+	vector<_MERGE_CURSOR> cursors(sources.size());
+	BarVector merged;
+
+	// the cursor with the earliest minute on top, the higher priority source first within a minute
+	auto later = [&cursors](size_t a, size_t b)
+	{
+		const long long ta = cursors[a].current().timestamp;
+		const long long tb = cursors[b].current().timestamp;
+		return ta != tb ? ta > tb : cursors[a].source > cursors[b].source;
+	};
+
+	auto mergeDay = [&](const fs::path& target, const vector<_SOURCE_DAY>& files)
+	{
+		// up to date when written after every source file of the day
+		const fs::file_time_type written = fs::exists(target, ec) ? fs::last_write_time(target, ec) : fs::file_time_type::min();
+		bool bStale = written == fs::file_time_type::min();
+		for (const auto& file : files)
+			bStale = bStale || (!file.csvFilename.empty() && file.lastWrite > written);
+
+		if (!bStale)
+		{
+			++result.skipped;
+			return;
+		}
+
+		priority_queue<size_t, vector<size_t>, decltype(later)> heap(later);
+		for (size_t s = 0; s < files.size(); ++s)
+		{
+			cursors[s].source = s;
+			cursors[s].bars.clear();
+			cursors[s].pos = 0;
+
+			if (!files[s].csvFilename.empty())
+				lOK = loadCursor(files[s].csvFilename, cursors[s]) && lOK;
+			if (!cursors[s].done())
+				heap.push(s);
+		}
+
+		merged.clear();
+		while (!heap.empty())
+		{
+			const size_t s = heap.top();
+			heap.pop();
+
+			const _BAR& bar = cursors[s].current();
+			if (!merged.empty() && merged.back().timestamp == bar.timestamp)
+			{
+				// a lower priority source's bar for a minute already taken
+				++result.conflicts;
+				const double winner = merged.back().close;
+				if (std::fabs(bar.close - winner) > tolerance * std::fabs(winner))
+					++result.disagreements;
+			}
+			else
+			{
+				merged.push_back(bar);
+				++result.won[s];
+			}
+
+			++cursors[s].pos;
+			if (!cursors[s].done())
+				heap.push(s);
+		}
+
+		if (!writeMergedDay(target, merged))
+		{
+			LOG_ERROR << "Cannot write " << target.string();
+			lOK = false;
+			return;
+		}
+
+		++result.days;
+		result.rows += merged.size();
+	};
+
+	// the trees are walked together one date folder at a time, over the union of the sources' dates, so
+	// only the file list of one date is held
+	vector<fs::path> roots;
+	for (const auto& source : sources)
+		roots.push_back(fs::path(source.basePath) / "Daily");
+
+	auto subfolders = [](const vector<fs::path>& parents, const string& name)
+	{
+		vector<fs::path> folders;
+		for (const auto& parent : parents)
+			folders.push_back(parent / name);
+		return folders;
+	};
+
+	SourceDayMap days;
+	for (const auto& year : listFolderNames(roots, true))
+	{
+		const vector<fs::path> years = subfolders(roots, year);
+		for (const auto& month : listFolderNames(years, true))
+		{
+			const vector<fs::path> months = subfolders(years, month);
+			for (const auto& date : listFolderNames(months, false))
+			{
+				days.clear();
+				for (size_t s = 0; s < sources.size(); ++s)
+					addSourceDays(months[s] / date, s, sources.size(), days);
+
+				const fs::path folder = fs::path(outputPath) / "Daily" / year / month / date;
+				for (const auto& symbol : days)
+					mergeDay(folder / (symbol.first + "_" + date + ".csv"), symbol.second);
+			}
+		}
+	}
+
+	return lOK;
+}
+
+
+MergeSourceVector makeMergeSources(const string& path, const vector<string>& priority)
+{
+	MergeSourceVector sources;
+
+	for (const auto& name : priority)
+	{
+		// same folders as the downloader, see alphaVantagePath() in Stocks.cpp
+		if (name == "Yahoo")
+			sources.push_back(_MERGE_SOURCE{ name, path });
+		else if (name == "AlphaVantage")
+			sources.push_back(_MERGE_SOURCE{ name, path + PathSeparator + "AlphaVantage" });
+		else
+			LOG_WARNING << "Unknown source " << name << ", expected Yahoo or AlphaVantage";
+	}
+
+	return sources;
+}
+
+
+bool mergeSourcePartitions(const _TICKER_TAPE_ARGS& args, SaveType saveType)
+{
+	MergeSourceVector sources = makeMergeSources(args.path, args.sourcePriority);
+
+	// a single source is already canonical, copying it would only double the tree
+	std::error_code ec;
+	size_t present = 0;
+	for (const auto& source : sources)
+		present += fs::exists(fs::path(source.basePath) / "Daily", ec) ? 1 : 0;
+
+	if (present < 2)
+	{
+		LOG_DEBUG << "Nothing to merge, " << present << " source tree(s) found under " << args.path;
+		return true;
+	}
+
+	const string mergedPath = args.path + PathSeparator + "Merged";
+
+	_MERGE_STATS stats;
+	bool lOK = SourceMerger(sources).run(mergedPath, &stats);
+
+	LOG_INFO << "Merged " << stats.rows << " bar(s) in " << stats.days << " symbol-day(s) into " << mergedPath
+		<< ", " << stats.skipped << " up to date, " << stats.conflicts << " conflict(s), " << stats.disagreements << " disagreeing";
+	for (size_t s = 0; s < sources.size(); ++s)
+		LOG_DEBUG << sources[s].name << ": " << stats.won[s] << " bar(s)";
+
+	if (lOK && args.bDeriveRollups && stats.days > 0)
+		lOK = compactPartitions(mergedPath, saveType);
+
+	return lOK;
+}
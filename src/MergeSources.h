@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include "Stock.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Merges the Daily partitions of several sources (the Yahoo Finance tree under <path> and the Alpha
+// Vantage tree under <path>/AlphaVantage) into one canonical Daily tree with the same layout.
+//
+// Every source writes one file per symbol and local day with UTC timestamps, so a symbol-day is merged
+// from the files of that day alone: each source's file is read into a cursor, its timestamps floored to
+// the minute, and the cursors are drained through a small heap ordered by (timestamp, source priority).
+// When sources have a bar for the same minute, the source listed first wins; the others count as
+// conflicts, and as disagreements when their close is further than <tolerance> (relative) from the
+// winner's. The trees are walked together one date folder at a time, so memory is the file list of one
+// date and one day of bars per source however large the trees are.
+//
+// A merged day is rewritten only when one of its source files is newer, so repeated runs cost a
+// directory walk plus the days that changed.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+struct _MERGE_SOURCE
+{
+	std::string name;						// for the log, e.g. "Yahoo"
+	std::string basePath;					// holds Daily/<y>/<m>/<date>/<SYM>_<date>.csv
+};
+
+using MergeSourceVector = std::vector<_MERGE_SOURCE>;
+
+struct _MERGE_STATS
+{
+	size_t days = 0;						// symbol-days written
+	size_t skipped = 0;						// symbol-days already up to date
+	size_t rows = 0;						// bars written
+	size_t conflicts = 0;					// bars dropped for a higher priority source's bar
+	size_t disagreements = 0;				// conflicts whose close differed by more than the tolerance
+	std::vector<size_t> won;				// bars written per source, in priority order
+};
+
+class SourceMerger
+{
+public:
+	// <sources> in priority order, highest first
+	explicit SourceMerger(MergeSourceVector sources, double tolerance = 0.001) : sources(std::move(sources)), tolerance(tolerance) {}
+
+	// writes the merged Daily partitions under <outputPath>
+	bool run(const std::string& outputPath, _MERGE_STATS* stats = nullptr) const;
+
+private:
+	MergeSourceVector sources;
+	double tolerance;
+};
+
+// orders <priority> names ("Yahoo", "AlphaVantage") into sources rooted at <path>; unknown names are skipped
+MergeSourceVector makeMergeSources(const std::string& path, const std::vector<std::string>& priority);
+
+// merges the sources of <args> into <path>/Merged and derives its rollups when the download does
+bool mergeSourcePartitions(const _TICKER_TAPE_ARGS& args, SaveType saveType);
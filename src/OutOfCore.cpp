@@ -0,0 +1,396 @@
+#include <algorithm>
+
+#include "OutOfCore.h"
+#include "BarStore.h"
+#include "CsvBars.h"
+#include "AsyncWriter.h"
+#include "Log.h"
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+constexpr size_t MinRunBufferRows = 1024;
+constexpr size_t MaxRunBufferBytes = size_t(1) << 20;
+
+static bool rowLess(const _CHUNK_ROW& a, const _CHUNK_ROW& b)
+{
+	return a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.symbol < b.symbol;
+}
+
+
+// subfolders of <folder>, ordered by their number (years, months) or name (dates), the first one last
+static vector<fs::path> listFolders(const fs::path& folder, bool bNumeric)
+{
+	vector<fs::path> folders;
+	std::error_code ec;
+
+	for (fs::directory_iterator itr(folder, ec), end; !ec && itr != end; itr.increment(ec))
+	{
+		if (itr->is_directory(ec))
+			folders.push_back(itr->path());
+	}
+
+	std::sort(folders.begin(), folders.end(), [bNumeric](const fs::path& a, const fs::path& b)
+	{
+		const string na = a.filename().string();
+		const string nb = b.filename().string();
+		return bNumeric ? atoi(na.c_str()) > atoi(nb.c_str()) : na > nb;
+	});
+
+	return folders;
+}
+
+
+// a sorted run on disk, read back through a fixed buffer
+struct ChunkedBarReader::_RUN_READER
+{
+	ifstream in;
+	ChunkRowVector rows;
+	size_t capacity = 0;
+	size_t pos = 0;
+
+	bool open(const fs::path& filename, size_t bufferRows)
+	{
+		in.open(filename, ios::binary);
+		capacity = bufferRows;
+		return in.is_open() && fill();
+	}
+
+	bool fill()
+	{
+		rows.resize(capacity);
+		in.read(reinterpret_cast<char*>(rows.data()), static_cast<streamsize>(capacity * sizeof(_CHUNK_ROW)));
+		rows.resize(static_cast<size_t>(in.gcount()) / sizeof(_CHUNK_ROW));
+		pos = 0;
+		return !rows.empty();
+	}
+
+	bool done() const { return pos >= rows.size(); }
+	const _CHUNK_ROW& current() const { return rows[pos]; }
+
+	void advance()
+	{
+		if (++pos >= rows.size())
+			fill();
+	}
+};
+
+
+ChunkedBarReader::ChunkedBarReader(const string& basePath, const _CHUNK_OPTIONS& options)
+	: spillFolder(options.spillFolder)
+{
+	// half the cap sorts a day, a quarter buffers the runs of a day that did not fit, a quarter is handed out
+	const size_t capRows = std::max<size_t>(options.memoryCap / sizeof(_CHUNK_ROW), 16 * MinRunBufferRows);
+	sortRows = capRows / 2;
+	chunkRows = capRows / 4;
+	runBufferRows = std::max(MinRunBufferRows, std::min(MaxRunBufferBytes / sizeof(_CHUNK_ROW), capRows / 16));
+
+	yearFolders = listFolders(fs::path(basePath) / "Daily", true);
+}
+
+
+ChunkedBarReader::~ChunkedBarReader()
+{
+	closeRuns();
+}
+
+
+uint32_t ChunkedBarReader::symbolIndex(const string& symbol)
+{
+	auto itr = index.find(symbol);
+	if (itr != index.end())
+		return itr->second;
+
+	const uint32_t s = static_cast<uint32_t>(names.size());
+	names.push_back(symbol);
+	index.emplace(symbol, s);
+	return s;
+}
+
+
+bool ChunkedBarReader::spill()
+{
+	std::sort(buffer.begin(), buffer.end(), rowLess);
+
+	std::error_code ec;
+	fs::create_directories(spillFolder, ec);
+
+	fs::path filename = spillFolder / ("run_" + to_string(runSerial++) + ".bin");
+	ofstream out(filename, ios::binary | ios::trunc);
+	out.write(reinterpret_cast<const char*>(buffer.data()), static_cast<streamsize>(buffer.size() * sizeof(_CHUNK_ROW)));
+	if (!out.good())
+	{
+		LOG_ERROR << "Cannot spill to " << filename.string();
+		bFailed = true;
+		return false;
+	}
+
+	runFiles.push_back(filename);
+	++runCount;
+	buffer.clear();
+	return true;
+}
+
+
+bool ChunkedBarReader::readDayFiles(const fs::path& folder)
+{
+	bool lOK = true;
+	std::error_code ec;
+	string name, date;
+
+	for (fs::directory_iterator itr(folder, ec), end; !ec && itr != end; itr.increment(ec))
+	{
+		if (!itr->is_regular_file(ec) || itr->path().extension() != ".csv")
+			continue;
+
+		if (!splitPartitionStem(itr->path().stem().string(), name, date))
+			continue;
+
+		const uint32_t symbol = symbolIndex(name);
+
+		lOK = readPartitionFile(itr->path(), [&](const _BAR& bar)
+		{
+			if (buffer.size() >= sortRows)
+				lOK = spill() && lOK;
+			buffer.push_back(_CHUNK_ROW{ bar.timestamp, symbol, bar.open, bar.high, bar.low, bar.close, bar.volume });
+		}) && lOK;
+	}
+
+	return lOK;
+}
+
+
+// merges runFiles into one run per <fanIn> until at most <fanIn> are left, then opens those for next()
+bool ChunkedBarReader::mergeRuns(size_t fanIn)
+{
+	auto later = [this](size_t a, size_t b) { return rowLess(runs[b]->current(), runs[a]->current()); };
+
+	auto openRuns = [this, &later](size_t count)
+	{
+		runs.clear();
+		runHeap.clear();
+		for (size_t r = 0; r < count; ++r)
+		{
+			runs.push_back(make_unique<_RUN_READER>());
+			if (runs.back()->open(runFiles[r], runBufferRows))
+				runHeap.push_back(r);
+		}
+		std::make_heap(runHeap.begin(), runHeap.end(), later);
+	};
+
+	while (runFiles.size() > fanIn)
+	{
+		openRuns(fanIn);
+
+		fs::path filename = spillFolder / ("run_" + to_string(runSerial++) + ".bin");
+		ofstream out(filename, ios::binary | ios::trunc);
+		ChunkRowVector outRows;
+		outRows.reserve(runBufferRows);
+
+		while (!runHeap.empty())
+		{
+			std::pop_heap(runHeap.begin(), runHeap.end(), later);
+			_RUN_READER& run = *runs[runHeap.back()];
+
+			outRows.push_back(run.current());
+			if (outRows.size() == runBufferRows)
+			{
+				out.write(reinterpret_cast<const char*>(outRows.data()), static_cast<streamsize>(outRows.size() * sizeof(_CHUNK_ROW)));
+				outRows.clear();
+			}
+
+			run.advance();
+			if (run.done())
+				runHeap.pop_back();
+			else
+				std::push_heap(runHeap.begin(), runHeap.end(), later);
+		}
+
+		out.write(reinterpret_cast<const char*>(outRows.data()), static_cast<streamsize>(outRows.size() * sizeof(_CHUNK_ROW)));
+		if (!out.good())
+		{
+			LOG_ERROR << "Cannot spill to " << filename.string();
+			bFailed = true;
+			return false;
+		}
+		out.close();
+
+		runs.clear();
+		std::error_code ec;
+		for (size_t r = 0; r < fanIn; ++r)
+			fs::remove(runFiles[r], ec);
+
+		runFiles.erase(runFiles.begin(), runFiles.begin() + fanIn);
+		runFiles.push_back(filename);
+		++runCount;
+	}
+
+	openRuns(runFiles.size());
+	return true;
+}
+
+
+void ChunkedBarReader::closeRuns()
+{
+	runs.clear();
+	runHeap.clear();
+
+	std::error_code ec;
+	for (const auto& filename : runFiles)
+		fs::remove(filename, ec);
+	runFiles.clear();
+}
+
+
+bool ChunkedBarReader::loadDay()
+{
+	while (dayFolders.empty())
+	{
+		while (monthFolders.empty())
+		{
+			if (yearFolders.empty())
+				return false;
+
+			monthFolders = listFolders(yearFolders.back(), true);
+			yearFolders.pop_back();
+		}
+
+		dayFolders = listFolders(monthFolders.back(), false);
+		monthFolders.pop_back();
+	}
+
+	const fs::path folder = dayFolders.back();
+	dayFolders.pop_back();
+
+	if (buffer.capacity() < sortRows)
+		buffer.reserve(sortRows);
+
+	buffer.clear();
+	bufferPos = 0;
+
+	bFailed = !readDayFiles(folder) || bFailed;
+	++dayCount;
+
+	if (runFiles.empty())
+	{
+		std::sort(buffer.begin(), buffer.end(), rowLess);
+		return true;
+	}
+
+	// the day did not fit: everything goes to disk and is merged back from there
+	LOG_DEBUG << folder.string() << " spilled to " << runFiles.size() << " run(s)";
+	if (!buffer.empty() && !spill())
+		return false;
+
+	const size_t fanIn = std::max<size_t>(2, (sortRows / 2) / runBufferRows);
+	return mergeRuns(fanIn);
+}
+
+
+bool ChunkedBarReader::next(ChunkRowVector& chunk)
+{
+	chunk.clear();
+
+	while (chunk.size() < chunkRows)
+	{
+		if (!runs.empty())
+		{
+			auto later = [this](size_t a, size_t b) { return rowLess(runs[b]->current(), runs[a]->current()); };
+
+			while (!runHeap.empty() && chunk.size() < chunkRows)
+			{
+				std::pop_heap(runHeap.begin(), runHeap.end(), later);
+				_RUN_READER& run = *runs[runHeap.back()];
+
+				chunk.push_back(run.current());
+				run.advance();
+				if (run.done())
+					runHeap.pop_back();
+				else
+					std::push_heap(runHeap.begin(), runHeap.end(), later);
+			}
+
+			if (runHeap.empty())
+				closeRuns();
+			continue;
+		}
+
+		if (bufferPos < buffer.size())
+		{
+			const size_t n = std::min(buffer.size() - bufferPos, chunkRows - chunk.size());
+			chunk.insert(chunk.end(), buffer.begin() + bufferPos, buffer.begin() + bufferPos + n);
+			bufferPos += n;
+			continue;
+		}
+
+		if (!loadDay())
+			break;
+	}
+
+	rowCount += chunk.size();
+	return !chunk.empty();
+}
+
+
+_CHUNK_OPTIONS makeChunkOptions(const _TICKER_TAPE_ARGS& args)
+{
+	_CHUNK_OPTIONS options;
+	options.memoryCap = args.memoryCapMB << 20;
+	options.spillFolder = getFullpath(args.path, args.spillFolder);
+	return options;
+}
+
+
+bool exportCombinedChunked(const string& basePath, const string& filename, const _CHUNK_OPTIONS& options)
+{
+	AsyncFileWriter outCombinedFile(filename);
+	if (!outCombinedFile.is_open())
+	{
+		LOG_ERROR << "Cannot open " << filename;
+		return false;
+	}
+
+	ChunkedBarReader reader(basePath, options);
+	ChunkRowVector chunk;
+
+	// same lines as writeCombinedData(): <timestamp> <symbol> <price> <volume>
+	while (reader.next(chunk))
+	{
+		for (const auto& row : chunk)
+		{
+			outCombinedFile.write(epoch_to_utc_string(static_cast<long>(row.timestamp)));
+			outCombinedFile.write(' ');
+			outCombinedFile.write(reader.symbols()[row.symbol]);
+			outCombinedFile.write(' ');
+			outCombinedFile.writeNumber(row.open);
+			outCombinedFile.write(' ');
+			outCombinedFile.writeNumber(row.volume);
+			outCombinedFile.write('\n');
+		}
+	}
+
+	bool lOK = outCombinedFile.close() && !reader.failed();
+	LOG_INFO << "Exported " << reader.rows() << " row(s) of " << reader.days() << " day(s) to " << filename
+		<< (reader.spilledRuns() > 0 ? ", " + to_string(reader.spilledRuns()) + " run(s) spilled" : string());
+
+	return lOK;
+}
+
+
+bool loadStockStore(const string& basePath, Stock& stocks)
+{
+	BarStore store;
+	if (!store.loadPartitions(basePath))
+		return false;
+
+	auto guard = store.lockShared();
+	for (const auto& entry : store.series())
+	{
+		const _BAR_SERIES& series = entry.second;
+		for (size_t i = 0; i < series.size(); ++i)
+			stocks[epoch_to_utc_string(static_cast<long>(series.timestamp[i]))].push_back(make_tuple(entry.first, series.open[i], static_cast<int>(series.volume[i])));
+	}
+
+	return true;
+}
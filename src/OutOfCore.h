@@ -0,0 +1,109 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+#include "Stock.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Out-of-core execution: the Daily partitions are read back as one time ordered stream of bars across
+// all symbols, handed out in chunks, so replay, resampling and exports never hold more than a chunk and
+// peak memory depends on the cap instead of the size of the archive.
+//
+// Days are walked in folder order, one date folder at a time, so not even the file list of the archive
+// is kept. A day's rows are gathered into a sort buffer of half the cap. When a day does not fit, the
+// buffer is sorted and spilled as a binary run to <spillFolder>, and the runs are k-way merged back
+// with a read buffer each, in several passes when there are too many runs for the buffers to stay a
+// useful size. Rows leave in chunks of at most a quarter of the cap.
+//
+// Symbols are numbered in the order they are met; the names are the only state that grows, with the
+// number of symbols rather than with the number of days.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+struct _CHUNK_OPTIONS
+{
+	size_t memoryCap = size_t(256) << 20;	// bytes of rows held at once
+	std::string spillFolder;				// sorted runs of days that do not fit, removed when merged
+};
+
+// one bar in the stream; symbol indexes ChunkedBarReader::symbols()
+struct _CHUNK_ROW
+{
+	long long timestamp;
+	uint32_t symbol;
+	double open;
+	double high;
+	double low;
+	double close;
+	long long volume;
+};
+
+using ChunkRowVector = std::vector<_CHUNK_ROW>;
+
+class ChunkedBarReader
+{
+public:
+	ChunkedBarReader(const std::string& basePath, const _CHUNK_OPTIONS& options);
+	~ChunkedBarReader();
+
+	ChunkedBarReader(const ChunkedBarReader&) = delete;
+	ChunkedBarReader& operator=(const ChunkedBarReader&) = delete;
+
+	// the next rows in (timestamp, symbol) order, false once the archive is exhausted
+	bool next(ChunkRowVector& chunk);
+
+	const std::vector<std::string>& symbols() const { return names; }
+
+	size_t rows() const { return rowCount; }
+	size_t days() const { return dayCount; }
+	size_t spilledRuns() const { return runCount; }
+	bool failed() const { return bFailed; }
+
+private:
+	struct _RUN_READER;
+
+	bool loadDay();
+	bool readDayFiles(const std::filesystem::path& folder);
+	bool spill();
+	bool mergeRuns(size_t fanIn);
+	void closeRuns();
+	uint32_t symbolIndex(const std::string& symbol);
+
+	std::filesystem::path spillFolder;
+	size_t sortRows;						// rows in the sort buffer before it spills
+	size_t chunkRows;						// rows handed out per next()
+	size_t runBufferRows;					// rows buffered per run while merging
+
+	std::vector<std::filesystem::path> dayFolders;	// Daily/<y>/<m>/<date> still to read, next day last
+	std::vector<std::filesystem::path> monthFolders;
+	std::vector<std::filesystem::path> yearFolders;
+
+	ChunkRowVector buffer;					// the day being sorted, or its rows still to hand out
+	size_t bufferPos = 0;
+
+	std::vector<std::filesystem::path> runFiles;
+	std::vector<std::unique_ptr<_RUN_READER>> runs;	// the day's runs being merged
+	std::vector<size_t> runHeap;			// runs with rows left, earliest row on top
+	size_t runSerial = 0;
+
+	std::vector<std::string> names;
+	std::unordered_map<std::string, uint32_t> index;
+
+	size_t rowCount = 0;
+	size_t dayCount = 0;
+	size_t runCount = 0;
+	bool bFailed = false;
+};
+
+// chunk options of <args>, or a cap of 0 when it runs in memory
+_CHUNK_OPTIONS makeChunkOptions(const _TICKER_TAPE_ARGS& args);
+
+// writes the combined "<timestamp> <symbol> <price> <volume>" file from the partitions under <basePath>
+bool exportCombinedChunked(const std::string& basePath, const std::string& filename, const _CHUNK_OPTIONS& options);
+
+// the in-memory counterpart of ChunkedBarReader: fills <stocks> from the same partitions under <basePath>, every
+// bar one trade of its volume at the open keyed by its UTC timestamp, so both modes replay and export one dataset
+bool loadStockStore(const std::string& basePath, Stock& stocks);
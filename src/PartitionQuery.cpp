@@ -0,0 +1,300 @@
+#include <fstream>
+#include <set>
+#include <ctime>
+#include <algorithm>
+
+#include "PartitionQuery.h"
+#include "CsvBars.h"
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+// one local calendar day of the query range, the unit Daily partitions are cut by
+struct _QUERY_DAY
+{
+	int year;
+	int month;
+	int week;								// same numbering as makeOutputFilenames()
+	string date;							// yyyy-mm-dd
+	bool bWhole;							// the whole day lies inside the range
+};
+
+// a rollup partition whose every day lies inside the range
+struct _ROLLUP_GROUP
+{
+	SaveType level;
+	fs::path folder;
+	string suffix;							// file name after "<SYM>_"
+	size_t firstDay;
+	size_t lastDay;
+};
+
+
+static bool isLeapYear(int year)
+{
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+
+static int daysInMonth(int year, int month)
+{
+	static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	return month == 2 && isLeapYear(year) ? 29 : days[month - 1];
+}
+
+
+// the local days overlapping [from, to)
+static vector<_QUERY_DAY> makeQueryDays(long long from, long long to)
+{
+	vector<_QUERY_DAY> days;
+	if (to <= from)
+		return days;
+
+	std::time_t first = static_cast<std::time_t>(std::max(from, 0LL));
+	std::tm tm{};
+	localtime_s(&tm, &first);
+	tm.tm_hour = 0;
+	tm.tm_min = 0;
+	tm.tm_sec = 0;
+
+	for (;;)
+	{
+		std::tm startTm = tm;
+		startTm.tm_isdst = -1;
+		const long long start = static_cast<long long>(std::mktime(&startTm));
+		if (start >= to || start == -1)
+			break;
+
+		std::tm endTm = startTm;
+		endTm.tm_mday += 1;
+		endTm.tm_isdst = -1;
+		const long long end = static_cast<long long>(std::mktime(&endTm));
+
+		_QUERY_DAY day;
+		day.year = startTm.tm_year + 1900;
+		day.month = startTm.tm_mon + 1;
+		day.week = startTm.tm_yday / 7;
+		day.bWhole = start >= from && end <= to;
+
+		char date[16];
+		std::strftime(date, sizeof(date), "%Y-%m-%d", &startTm);
+		day.date = date;
+		days.push_back(day);
+
+		tm = startTm;
+		tm.tm_mday += 1;
+	}
+
+	return days;
+}
+
+
+// rollups made only of whole days of the range, coarsest level first
+static vector<_ROLLUP_GROUP> makeRollupGroups(const string& basePath, const vector<_QUERY_DAY>& days)
+{
+	vector<_ROLLUP_GROUP> groups;
+	const fs::path base(basePath);
+
+	struct _LEVEL
+	{
+		SaveType level;
+		function<bool(const _QUERY_DAY&, const _QUERY_DAY&)> sameGroup;
+		function<int(const _QUERY_DAY&)> expectedDays;
+		function<fs::path(const _QUERY_DAY&)> folder;
+		function<string(const _QUERY_DAY&)> suffix;
+	};
+
+	const _LEVEL levels[] =
+	{
+		{
+			SaveType::YearlyFile,
+			[](const _QUERY_DAY& a, const _QUERY_DAY& b) { return a.year == b.year; },
+			[](const _QUERY_DAY& d) { return isLeapYear(d.year) ? 366 : 365; },
+			[&](const _QUERY_DAY& d) { return base / "Yearly" / to_string(d.year); },
+			[](const _QUERY_DAY& d) { return to_string(d.year); }
+		},
+		{
+			SaveType::MonthlyFile,
+			[](const _QUERY_DAY& a, const _QUERY_DAY& b) { return a.year == b.year && a.month == b.month; },
+			[](const _QUERY_DAY& d) { return daysInMonth(d.year, d.month); },
+			[&](const _QUERY_DAY& d) { return base / "Monthly" / to_string(d.year) / to_string(d.month); },
+			[](const _QUERY_DAY& d) { return d.date.substr(0, 7); }
+		},
+		{
+			SaveType::WeeklyFile,
+			[](const _QUERY_DAY& a, const _QUERY_DAY& b) { return a.year == b.year && a.week == b.week; },
+			[](const _QUERY_DAY& d) { return std::min(7, (isLeapYear(d.year) ? 366 : 365) - d.week * 7); },
+			[&](const _QUERY_DAY& d) { return base / "Weekly" / to_string(d.year) / ("week_" + to_string(d.week)); },
+			[](const _QUERY_DAY& d) { return to_string(d.year) + "-W" + to_string(d.week); }
+		},
+	};
+
+	for (const auto& level : levels)
+	{
+		for (size_t first = 0; first < days.size();)
+		{
+			size_t last = first;
+			bool bWhole = days[first].bWhole;
+			while (last + 1 < days.size() && level.sameGroup(days[first], days[last + 1]))
+			{
+				++last;
+				bWhole = bWhole && days[last].bWhole;
+			}
+
+			if (bWhole && static_cast<int>(last - first + 1) == level.expectedDays(days[first]))
+				groups.push_back(_ROLLUP_GROUP{ level.level, level.folder(days[first]), level.suffix(days[first]), first, last });
+
+			first = last + 1;
+		}
+	}
+
+	return groups;
+}
+
+
+static fs::path dailyFolder(const string& basePath, const _QUERY_DAY& day)
+{
+	return fs::path(basePath) / "Daily" / to_string(day.year) / to_string(day.month) / day.date;
+}
+
+
+// symbols with a partition in <folder>: <SYM>_<suffix>.csv
+static void addFolderSymbols(const fs::path& folder, set<string>& symbols)
+{
+	std::error_code ec;
+	string symbol, period;
+	for (fs::directory_iterator itr(folder, ec), end; !ec && itr != end; itr.increment(ec))
+	{
+		if (!itr->is_regular_file(ec) || itr->path().extension() != ".csv")
+			continue;
+
+		if (splitPartitionStem(itr->path().stem().string(), symbol, period))
+			symbols.insert(symbol);
+	}
+}
+
+
+PartitionFileVector PartitionQuery::plan(const vector<string>& symbols, long long from, long long to) const
+{
+	PartitionFileVector files;
+
+	const vector<_QUERY_DAY> days = makeQueryDays(from, to);
+	if (days.empty())
+		return files;
+
+	const vector<_ROLLUP_GROUP> groups = makeRollupGroups(basePath, days);
+	std::error_code ec;
+
+	// without a symbol list, list the folders of the coarsest existing rollup for every day and the Daily
+	// folders of the days no rollup folder covers
+	vector<string> wanted = symbols;
+	if (wanted.empty())
+	{
+		set<string> found;
+		vector<bool> listed(days.size(), false);
+
+		for (const auto& group : groups)
+		{
+			if (listed[group.firstDay] || !fs::exists(group.folder, ec))
+				continue;
+
+			addFolderSymbols(group.folder, found);
+			std::fill(listed.begin() + group.firstDay, listed.begin() + group.lastDay + 1, true);
+		}
+
+		for (size_t d = 0; d < days.size(); ++d)
+		{
+			if (!listed[d])
+				addFolderSymbols(dailyFolder(basePath, days[d]), found);
+		}
+
+		wanted.assign(found.begin(), found.end());
+	}
+
+	size_t counts[4] = {};		// Yearly, Monthly, Weekly, Daily
+
+	for (const auto& symbol : wanted)
+	{
+		vector<bool> covered(days.size(), false);
+		vector<pair<size_t, _PARTITION_FILE>> symbolFiles;
+
+		for (const auto& group : groups)
+		{
+			if (std::find(covered.begin() + group.firstDay, covered.begin() + group.lastDay + 1, true) != covered.begin() + group.lastDay + 1)
+				continue;
+
+			fs::path filename = group.folder / (symbol + "_" + group.suffix + ".csv");
+			if (!fs::exists(filename, ec))
+				continue;
+
+			symbolFiles.emplace_back(group.firstDay, _PARTITION_FILE{ symbol, group.level, filename, false });
+			std::fill(covered.begin() + group.firstDay, covered.begin() + group.lastDay + 1, true);
+			++counts[group.level == SaveType::YearlyFile ? 0 : group.level == SaveType::MonthlyFile ? 1 : 2];
+		}
+
+		for (size_t d = 0; d < days.size(); ++d)
+		{
+			if (covered[d])
+				continue;
+
+			fs::path filename = dailyFolder(basePath, days[d]) / (symbol + "_" + days[d].date + ".csv");
+			if (!fs::exists(filename, ec))
+				continue;
+
+			symbolFiles.emplace_back(d, _PARTITION_FILE{ symbol, SaveType::DailyFile, filename, !days[d].bWhole });
+			++counts[3];
+		}
+
+		std::sort(symbolFiles.begin(), symbolFiles.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		for (auto& file : symbolFiles)
+			files.push_back(std::move(file.second));
+	}
+
+	LOG_INFO << "Query of " << days.size() << " day(s) for " << wanted.size() << " symbol(s) reads " << files.size() << " file(s): "
+		<< counts[0] << " yearly, " << counts[1] << " monthly, " << counts[2] << " weekly, " << counts[3] << " daily";
+
+	return files;
+}
+
+
+bool PartitionQuery::read(const PartitionFileVector& files, long long from, long long to, const PartitionBarCallback& onBar) const
+{
+	bool lOK = true;
+	size_t rejected = 0;
+
+	for (const auto& file : files)
+	{
+		LOG_DEBUG << "Reading " << file.filename.string() << (file.bFilter ? " (filtered)" : "");
+
+		lOK = readPartitionFile(file.filename, [&](const _BAR& bar)
+		{
+			if (!file.bFilter || (bar.timestamp >= from && bar.timestamp < to))
+				onBar(file.symbol, bar);
+		}, &rejected) && lOK;
+	}
+
+	if (rejected > 0)
+		LOG_WARNING << "Skipped " << rejected << " malformed row(s) in the queried partitions";
+
+	return lOK;
+}
+
+
+bool PartitionQuery::load(BarStore& store, const vector<string>& symbols, long long from, long long to) const
+{
+	const PartitionFileVector files = plan(symbols, from, to);
+
+	// the plan lists each symbol's files together and in time order, as loadFiles() wants them
+	BarFileVector loads;
+	loads.reserve(files.size());
+	for (const auto& file : files)
+	{
+		if (file.bFilter)
+			loads.push_back(_BAR_FILE{ file.symbol, file.filename, from, to });
+		else
+			loads.push_back(_BAR_FILE{ file.symbol, file.filename });
+	}
+
+	return store.loadFiles(loads);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "Stock.h"
+#include "BarStore.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Reads bars for some symbols and a time range back out of the partition tree (see Compaction.cpp for
+// the layout) touching as few files as possible. The range is split into the local trading days the
+// Daily partitions are cut by; per symbol the plan then takes, coarsest first,
+//
+//   Yearly    for every year the range covers completely
+//   Monthly   for every remaining month covered completely
+//   Weekly    for every remaining week covered completely
+//   Daily     for the days that are left, which includes the partial days at both ends
+//
+// whenever that partition exists; a missing rollup falls through to the finer levels. Only the days at
+// the edges of the range are filtered row by row. Files are streamed in chunks, so memory stays flat
+// however long the range is.
+//
+// Rollups are taken as current: compaction rewrites them after every download.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+struct _PARTITION_FILE
+{
+	std::string symbol;
+	SaveType level;							// DailyFile, WeeklyFile, MonthlyFile or YearlyFile
+	std::filesystem::path filename;
+	bool bFilter;							// only rows in the query range are wanted
+};
+
+using PartitionFileVector = std::vector<_PARTITION_FILE>;
+using PartitionBarCallback = std::function<void(const std::string& symbol, const _BAR& bar)>;
+
+class PartitionQuery
+{
+public:
+	explicit PartitionQuery(const std::string& basePath) : basePath(basePath) {}
+
+	// files covering [from, to) (UTC epoch seconds) for <symbols>, every symbol found in the range when empty
+	PartitionFileVector plan(const std::vector<std::string>& symbols, long long from, long long to) const;
+
+	// streams the rows of <files> that fall in [from, to), per file in time order
+	bool read(const PartitionFileVector& files, long long from, long long to, const PartitionBarCallback& onBar) const;
+
+	// plan + read into <store>, the files in parallel
+	bool load(BarStore& store, const std::vector<std::string>& symbols, long long from, long long to) const;
+
+private:
+	std::string basePath;
+};
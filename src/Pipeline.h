@@ -0,0 +1,153 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+
+#include "Log.h"
+
+using PipelineClock = std::chrono::steady_clock;
+
+// Fixed capacity queue between two pipeline stages. push() blocks while the queue is full, which is what
+// bounds the memory of the whole pipeline; pop() blocks while it is empty and returns false once the queue
+// was closed and drained. Depth is sampled on every push for the stage report.
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		notFull.wait(guard, [this] { return bClosed || items.size() < capacity; });
+		if (bClosed)
+			return false;
+
+		items.push_back(std::move(item));
+		depthSum += items.size();
+		++depthSamples;
+		if (items.size() > maxDepth) maxDepth = items.size();
+
+		notEmpty.notify_one();
+		return true;
+	}
+
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		notEmpty.wait(guard, [this] { return bClosed || !items.empty(); });
+		if (items.empty())
+			return false;
+
+		item = std::move(items.front());
+		items.pop_front();
+
+		notFull.notify_one();
+		return true;
+	}
+
+	// as pop(), but gives up at <deadline>; <bEnded> tells a timeout from the end of the stream
+	bool popUntil(T& item, PipelineClock::time_point deadline, bool& bEnded)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		bEnded = false;
+		if (!notEmpty.wait_until(guard, deadline, [this] { return bClosed || !items.empty(); }))
+			return false;
+
+		if (items.empty())
+		{
+			bEnded = true;
+			return false;
+		}
+
+		item = std::move(items.front());
+		items.pop_front();
+
+		notFull.notify_one();
+		return true;
+	}
+
+	// no more pushes; consumers drain what is left
+	void close()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		bClosed = true;
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+
+	size_t depth()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return items.size();
+	}
+
+	size_t getCapacity() const { return capacity; }
+	size_t getMaxDepth() const { return maxDepth; }
+	double getAverageDepth() const { return depthSamples ? static_cast<double>(depthSum) / depthSamples : 0.0; }
+
+private:
+	size_t capacity;
+	std::deque<T> items;
+	bool bClosed = false;
+
+	size_t maxDepth = 0;
+	size_t depthSum = 0;
+	size_t depthSamples = 0;
+
+	std::mutex lock;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+};
+
+
+// Per stage accounting: busy time is the time spent working on items, the rest of the stage's wall time
+// was spent waiting on its input or on back pressure from its output queue. A stage run by several
+// threads adds up their busy time and is measured against workers * wall time.
+struct _STAGE_STATS
+{
+	std::string name;
+	size_t workers = 1;
+	size_t items = 0;
+	PipelineClock::duration busy{ 0 };
+	PipelineClock::time_point started = PipelineClock::now();
+	PipelineClock::time_point stopped = PipelineClock::now();
+
+	void begin() { started = PipelineClock::now(); }
+	void end() { stopped = PipelineClock::now(); }
+
+	void addBusy(PipelineClock::time_point from)
+	{
+		busy += PipelineClock::now() - from;
+		++items;
+	}
+
+	double utilization() const
+	{
+		double wall = std::chrono::duration<double>(stopped - started).count();
+		return wall > 0.0 ? std::chrono::duration<double>(busy).count() / (wall * workers) : 0.0;
+	}
+
+	template <typename T>
+	void report(const BoundedQueue<T>* output) const
+	{
+		std::ostringstream line;
+		line << std::left << std::setw(10) << name << std::right
+			<< " threads=" << workers
+			<< " items=" << std::setw(7) << items
+			<< " wall=" << std::fixed << std::setprecision(2) << std::chrono::duration<double>(stopped - started).count() << "s"
+			<< " utilization=" << std::setprecision(1) << utilization() * 100.0 << "%";
+
+		if (output)
+		{
+			line << " output queue avg=" << std::setprecision(1) << output->getAverageDepth()
+				<< " max=" << output->getMaxDepth() << "/" << output->getCapacity();
+		}
+
+		LOG_INFO << line.str();
+	}
+};
@@ -0,0 +1,113 @@
+#include <random>
+#include <thread>
+#include <cmath>
+
+#include "Stream.h"
+#include "Log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Stand-in trade publisher, so the live ingest path can be load tested without a market data feed:
+//
+//   TickerTape.exe /Publish=tcp://127.0.0.1:9100        one terminal
+//   TickerTape.exe /Stream=tcp://127.0.0.1:9100         another terminal
+//   TickerTape.exe /Publish=- | TickerTape.exe /Stream=-
+//
+// Symbols are drawn with Zipf-like weights so the top-N has a stable head and a churning tail.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+static const vector<string> DefaultSymbols =
+{
+	"NVDA", "MSFT", "AAPL", "AMZN", "GOOGL", "META", "TSLA", "AVGO", "AMD", "INTC",
+	"IBM", "ORCL", "CSCO", "QCOM", "ADBE", "CRM", "NFLX", "TXN", "MU", "AMAT"
+};
+
+
+// publishes to one subscriber until it leaves or <remaining> trades were sent; returns the number sent
+static size_t publishTo(StreamConnection& connection, const _PUBLISHER_OPTIONS& options, const vector<string>& symbols, size_t remaining, mt19937& random)
+{
+	vector<double> weights;
+	vector<double> prices;
+	for (size_t i = 0; i < symbols.size(); ++i)
+	{
+		weights.push_back(1.0 / static_cast<double>(i + 1));
+		prices.push_back(50.0 + 25.0 * static_cast<double>(i));
+	}
+
+	discrete_distribution<size_t> pickSymbol(weights.begin(), weights.end());
+	geometric_distribution<int> pickLots(0.2);
+	normal_distribution<double> priceStep(0.0, 0.0005);
+
+	// trades go out in slices of ~1 ms worth, paced against the start time so the rate does not drift
+	const bool bPaced = options.tradesPerSecond > 0.0;
+	const size_t sliceSize = bPaced ? std::max<size_t>(1, static_cast<size_t>(options.tradesPerSecond / 1000.0)) : 4096;
+	const auto started = steady_clock::now();
+
+	string buffer;
+	size_t sent = 0;
+	_TRADE trade;
+
+	while (remaining == 0 || sent < remaining)
+	{
+		size_t count = remaining == 0 ? sliceSize : std::min(sliceSize, remaining - sent);
+		buffer.clear();
+
+		TimePoint now = system_clock::now();
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t s = pickSymbol(random);
+			prices[s] *= 1.0 + priceStep(random);
+
+			trade.stkSym = symbols[s];
+			trade.numShares = 100 * (1 + pickLots(random));
+			trade.price = prices[s];
+			trade.transTime = now;
+			encodeTrade(trade, options.framing, buffer);
+		}
+
+		if (!connection.writeAll(buffer))
+			break;
+
+		sent += count;
+
+		if (bPaced)
+			this_thread::sleep_until(started + duration_cast<steady_clock::duration>(duration<double>(sent / options.tradesPerSecond)));
+	}
+
+	double elapsed = duration<double>(steady_clock::now() - started).count();
+	LOG_INFO << "Published " << sent << " trade(s) in " << elapsed << "s ("
+		<< (elapsed > 0.0 ? static_cast<long long>(sent / elapsed) : 0) << " trades/s)";
+
+	return sent;
+}
+
+
+bool runPublisher(const _PUBLISHER_OPTIONS& options)
+{
+	auto listener = StreamListener::listen(options.endpoint);
+	if (!listener)
+	{
+		LOG_ERROR << "Cannot listen on " << options.endpoint.describe();
+		return false;
+	}
+
+	const vector<string>& symbols = options.symbols.empty() ? DefaultSymbols : options.symbols;
+	mt19937 random(options.seed);
+	size_t published = 0;
+
+	LOG_INFO << "Publishing " << (options.framing == StreamFraming::Binary ? "binary" : "line") << " trades on " << options.endpoint.describe();
+
+	// subscribers are served one after another until the requested count has gone out
+	while (options.count == 0 || published < options.count)
+	{
+		auto connection = listener->accept();
+		if (!connection)
+			break;
+
+		published += publishTo(*connection, options, symbols, options.count == 0 ? 0 : options.count - published, random);
+	}
+
+	return true;
+}
@@ -0,0 +1,238 @@
+#include <cstdint>
+#include <algorithm>
+
+#include "RangePlanner.h"
+#include "Log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Request-range planning for the 1m chart endpoint.
+//
+// Instead of one request per symbol per calendar day, the planner drops weekends, NYSE holidays and days
+// outside the provider's lookback window, then packs each symbol's remaining days into requests whose
+// [period1, period2) span stays within maxDaysPerRequest calendar days. Every request keeps the list of
+// local days it covers so the response can be split back into Daily partitions.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+// 0 = Sunday, Sakamoto's method
+static int dayOfWeek(int year, int month, int day)
+{
+	static const int offsets[] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+	if (month < 3) year -= 1;
+	return (year + year / 4 - year / 100 + year / 400 + offsets[month - 1] + day) % 7;
+}
+
+
+static int daysInMonth(int year, int month)
+{
+	static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+	return month == 2 && leap ? 29 : days[month - 1];
+}
+
+
+// n-th (1 based) weekday of a month, n = -1 selects the last one
+static int nthWeekday(int year, int month, int weekday, int n)
+{
+	if (n > 0)
+	{
+		int first = dayOfWeek(year, month, 1);
+		return 1 + (weekday - first + 7) % 7 + (n - 1) * 7;
+	}
+
+	int lastDay = daysInMonth(year, month);
+	int last = dayOfWeek(year, month, lastDay);
+	return lastDay - (last - weekday + 7) % 7;
+}
+
+
+// Gregorian Easter Sunday (anonymous algorithm), returned as month * 100 + day
+static int easterSunday(int year)
+{
+	int a = year % 19, b = year / 100, c = year % 100;
+	int d = b / 4, e = b % 4, f = (b + 8) / 25, g = (b - f + 1) / 3;
+	int h = (19 * a + b - d - g + 15) % 30;
+	int i = c / 4, k = c % 4;
+	int l = (32 + 2 * e + 2 * i - h - k) % 7;
+	int m = (a + 11 * h + 22 * l) / 451;
+	int month = (h + l - 7 * m + 114) / 31;
+	int day = ((h + l - 7 * m + 114) % 31) + 1;
+	return month * 100 + day;
+}
+
+
+// fixed date holidays move to Friday when on a Saturday and to Monday when on a Sunday
+static int observed(int year, int month, int day)
+{
+	int wday = dayOfWeek(year, month, day);
+	if (wday == 6) --day;
+	if (wday == 0) ++day;
+	return month * 100 + day;
+}
+
+
+static vector<int> nyseHolidays(int year)
+{
+	vector<int> holidays;
+
+	// New Year's Day is not observed on the preceding Friday when it falls on a Saturday
+	if (dayOfWeek(year, 1, 1) != 6)
+		holidays.push_back(observed(year, 1, 1));
+
+	holidays.push_back(100 + nthWeekday(year, 1, 1, 3));		// Martin Luther King Jr. Day
+	holidays.push_back(200 + nthWeekday(year, 2, 1, 3));		// Washington's Birthday
+
+	int easter = easterSunday(year);							// Good Friday
+	int month = easter / 100, day = easter % 100 - 2;
+	if (day < 1) { month -= 1; day += daysInMonth(year, month); }
+	holidays.push_back(month * 100 + day);
+
+	holidays.push_back(500 + nthWeekday(year, 5, 1, -1));		// Memorial Day
+	if (year >= 2022)
+		holidays.push_back(observed(year, 6, 19));				// Juneteenth
+	holidays.push_back(observed(year, 7, 4));					// Independence Day
+	holidays.push_back(900 + nthWeekday(year, 9, 1, 1));		// Labor Day
+	holidays.push_back(1100 + nthWeekday(year, 11, 4, 4));		// Thanksgiving Day
+	holidays.push_back(observed(year, 12, 25));					// Christmas Day
+
+	return holidays;
+}
+
+
+bool isTradingDay(const std::tm& localDay)
+{
+	int year = localDay.tm_year + 1900;
+	int month = localDay.tm_mon + 1;
+	int wday = dayOfWeek(year, month, localDay.tm_mday);
+
+	if (wday == 0 || wday == 6)
+		return false;
+
+	vector<int> holidays = nyseHolidays(year);
+	return std::find(holidays.begin(), holidays.end(), month * 100 + localDay.tm_mday) == holidays.end();
+}
+
+
+TradingDayVector listTradingDays(const TimePoint& start, const TimePoint& end)
+{
+	TradingDayVector days;
+
+	std::tm tm{};
+	if (!timePointToLocalTm(start, tm))
+		return days;
+
+	// step by calendar day through mktime so DST changes never repeat or skip a day
+	tm.tm_hour = 12;
+	tm.tm_min = 0;
+	tm.tm_sec = 0;
+
+	for (;;)
+	{
+		tm.tm_isdst = -1;
+		std::time_t t = std::mktime(&tm);
+		if (t == (std::time_t)-1)
+			break;
+
+		TimePoint day = system_clock::from_time_t(t);
+		auto [p1, p2] = computeLocalDayEpochRange(day);
+		if (p1 > system_clock::to_time_t(end))
+			break;
+
+		if (isTradingDay(tm))
+		{
+			char daybuf[16];
+			std::strftime(daybuf, sizeof(daybuf), "%Y-%m-%d", &tm);
+			days.push_back(_TRADING_DAY{ day, daybuf, p1, p2 });
+		}
+
+		tm.tm_mday += 1;
+	}
+
+	return days;
+}
+
+
+RangeRequestVector planRangeRequests
+(
+	const map<string, string>& symbols,
+	const TimePoint& start,
+	const TimePoint& end,
+	const TimePoint& now,
+	int maxDaysPerRequest,
+	int lookbackDays,
+	const DayFilter& isNeeded
+)
+{
+	RangeRequestVector requests;
+
+	TradingDayVector days = listTradingDays(start, end);
+
+	// the provider rejects anything that starts before its lookback window
+	const long long oldest = static_cast<long long>(system_clock::to_time_t(now)) - static_cast<long long>(lookbackDays) * 24 * 3600;
+	auto firstValid = std::find_if(days.begin(), days.end(), [oldest](const _TRADING_DAY& d) { return d.period1 >= oldest; });
+	if (firstValid != days.begin())
+	{
+		LOG_WARNING << "Skipping " << std::distance(days.begin(), firstValid) << " trading day(s) older than " << lookbackDays << " days";
+		days.erase(days.begin(), firstValid);
+	}
+
+	const long long maxSpan = static_cast<long long>(maxDaysPerRequest) * 24 * 3600;
+
+	// the needed days, as indexes into <days>, packed into requests of at most maxSpan seconds. A needed day that
+	// is not the trading day after the previous one starts a new request, so complete days in between are not fetched again
+	auto pack = [&days, maxSpan](const vector<size_t>& needed)
+	{
+		vector<TradingDayVector> groups;
+		size_t previous = SIZE_MAX;
+		for (size_t d : needed)
+		{
+			if (groups.empty() || d != previous + 1 || days[d].period2 - groups.back().front().period1 > maxSpan)
+				groups.emplace_back();
+
+			groups.back().push_back(days[d]);
+			previous = d;
+		}
+		return groups;
+	};
+
+	// without a filter the packing only depends on the calendar, so it is computed once for every symbol
+	vector<TradingDayVector> calendarGroups;
+	if (!isNeeded)
+	{
+		vector<size_t> all(days.size());
+		for (size_t d = 0; d < days.size(); ++d)
+			all[d] = d;
+		calendarGroups = pack(all);
+	}
+
+	size_t skipped = 0;
+
+	for (const auto& symbol : symbols)
+	{
+		vector<TradingDayVector> groups;
+
+		if (isNeeded)
+		{
+			vector<size_t> needed;
+			for (size_t d = 0; d < days.size(); ++d)
+			{
+				if (isNeeded(symbol.first, days[d]))
+					needed.push_back(d);
+				else
+					++skipped;
+			}
+
+			groups = pack(needed);
+		}
+
+		for (const auto& group : isNeeded ? groups : calendarGroups)
+			requests.push_back(_RANGE_REQUEST{ symbol.first, group.front().period1, group.back().period2, group });
+	}
+
+	if (skipped > 0)
+		LOG_INFO << "Skipping " << skipped << " symbol-day(s) already complete";
+
+	return requests;
+}
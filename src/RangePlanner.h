@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <functional>
+
+#include "Stock.h"
+
+// one local calendar day and its [period1, period2) epoch range
+struct _TRADING_DAY
+{
+	TimePoint day;
+	std::string date;		// yyyy-mm-dd
+	long long period1;
+	long long period2;
+};
+
+using TradingDayVector = std::vector<_TRADING_DAY>;
+
+// one provider request covering several consecutive trading days of a symbol
+struct _RANGE_REQUEST
+{
+	std::string symbol;
+	long long period1;
+	long long period2;
+	TradingDayVector days;
+};
+
+using RangeRequestVector = std::vector<_RANGE_REQUEST>;
+
+// decides whether a symbol-day still has to be fetched, e.g. from the partition manifest
+using DayFilter = std::function<bool(const std::string& symbol, const _TRADING_DAY& day)>;
+
+// Yahoo serves at most 8 days of 1m data per request, and only within the last 30 days (see Docs/Notes.txt)
+constexpr int YahooMaxDaysPerRequest = 8;
+constexpr int YahooLookbackDays = 30;
+
+bool isTradingDay(const std::tm& localDay);
+
+TradingDayVector listTradingDays(const TimePoint& start, const TimePoint& end);
+
+RangeRequestVector planRangeRequests
+(
+	const std::map<std::string, std::string>& symbols,
+	const TimePoint& start,
+	const TimePoint& end,
+	const TimePoint& now,
+	int maxDaysPerRequest = YahooMaxDaysPerRequest,
+	int lookbackDays = YahooLookbackDays,
+	const DayFilter& isNeeded = nullptr
+);
@@ -0,0 +1,111 @@
+#include <thread>
+#include <algorithm>
+
+#include "RateLimiter.h"
+
+using namespace std;
+using namespace std::chrono;
+
+
+TokenBucket::TokenBucket(double ratePerSecond, double burst)
+	: configuredRate(ratePerSecond), rate(ratePerSecond), burst(std::max(burst, 1.0)), tokens(std::max(burst, 1.0)), last(RateClock::now())
+{
+}
+
+
+void TokenBucket::refill(RateClock::time_point now)
+{
+	// <last> lies in the future while a Retry-After window is open, nothing accrues until then
+	if (now <= last)
+		return;
+
+	double elapsed = duration<double>(now - last).count();
+	tokens = std::min(burst, tokens + elapsed * rate);
+	last = now;
+}
+
+
+RateClock::duration TokenBucket::reserve()
+{
+	auto now = RateClock::now();
+	refill(now);
+
+	tokens -= 1.0;
+
+	RateClock::duration wait = last > now ? last - now : RateClock::duration::zero();
+	if (tokens < 0.0)
+		wait += duration_cast<RateClock::duration>(duration<double>(-tokens / rate));
+
+	return wait;
+}
+
+
+void TokenBucket::onThrottled(seconds retryAfter)
+{
+	// without Retry-After fall back to exponential backoff: 2,4,8... seconds
+	if (retryAfter.count() <= 0)
+		retryAfter = seconds(2 << std::min(throttleCount, 6));
+
+	++throttleCount;
+
+	auto resume = RateClock::now() + retryAfter;
+	last = std::max(last, resume);
+	tokens = std::min(tokens, 0.0);
+	rate = std::max(rate / 2.0, configuredRate / 16.0);
+}
+
+
+void TokenBucket::onSuccess()
+{
+	throttleCount = 0;
+	rate = std::min(configuredRate, rate + configuredRate / 20.0);
+}
+
+
+void RateScheduler::configure(const string& provider, double requestsPerSecond, double burst)
+{
+	lock_guard<mutex> guard(lock);
+	buckets.insert_or_assign(provider, TokenBucket(requestsPerSecond, burst));
+}
+
+
+RateClock::duration RateScheduler::reserve(const string& provider)
+{
+	lock_guard<mutex> guard(lock);
+
+	auto itr = buckets.find(provider);
+	if (itr == buckets.end())
+		return RateClock::duration::zero();
+
+	return itr->second.reserve();
+}
+
+
+void RateScheduler::acquire(const string& provider)
+{
+	auto wait = reserve(provider);
+	if (wait > RateClock::duration::zero())
+		this_thread::sleep_for(wait);
+}
+
+
+void RateScheduler::onResponse(const string& provider, long httpCode, long long retryAfterSeconds)
+{
+	lock_guard<mutex> guard(lock);
+
+	auto itr = buckets.find(provider);
+	if (itr == buckets.end())
+		return;
+
+	if (httpCode == 429)
+		itr->second.onThrottled(seconds(retryAfterSeconds));
+	else if (httpCode == 200)
+		itr->second.onSuccess();
+}
+
+
+RateScheduler& getRateScheduler()
+{
+	static RateScheduler scheduler;
+	return scheduler;
+}
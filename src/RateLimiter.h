@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+
+using RateClock = std::chrono::steady_clock;
+
+// Token bucket for one provider. reserve() always takes a token and returns how long the caller has to
+// wait before using it, so concurrent callers are queued fairly instead of polling. A 429 empties the
+// bucket, honours Retry-After and halves the rate; every success earns part of the rate back.
+class TokenBucket
+{
+public:
+	TokenBucket(double ratePerSecond = 1.0, double burst = 1.0);
+
+	RateClock::duration reserve();
+	void onThrottled(std::chrono::seconds retryAfter);
+	void onSuccess();
+
+	double currentRate() const { return rate; }
+
+private:
+	void refill(RateClock::time_point now);
+
+	double configuredRate;
+	double rate;
+	double burst;
+	double tokens;
+	RateClock::time_point last;
+	int throttleCount = 0;
+};
+
+// One TokenBucket per provider, shared by every thread that talks to that provider. Requests to different
+// providers never wait on each other.
+class RateScheduler
+{
+public:
+	void configure(const std::string& provider, double requestsPerSecond, double burst);
+
+	// non-blocking: reserve a slot and return the delay before it may be used
+	RateClock::duration reserve(const std::string& provider);
+
+	// blocking: wait until the reserved slot comes up
+	void acquire(const std::string& provider);
+
+	// feed the outcome of a request back into the provider's bucket
+	void onResponse(const std::string& provider, long httpCode, long long retryAfterSeconds);
+
+private:
+	std::mutex lock;
+	std::map<std::string, TokenBucket> buckets;
+};
+
+RateScheduler& getRateScheduler();
+
+// provider names used with the scheduler
+inline const std::string YahooProvider = "yahoo";
+inline const std::string AlphaVantageProvider = "alphavantage";
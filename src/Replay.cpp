@@ -0,0 +1,216 @@
+#include <cstdio>
+#include <ctime>
+#include <thread>
+#include <algorithm>
+#include <climits>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+#include "Replay.h"
+#include "Log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+using ReplayClock = steady_clock;
+
+bool parseUtcTimestamp(const string& text, TimePoint& timePoint)
+{
+	long long epoch = 0;
+	if (!utc_string_to_epoch(text, epoch))
+		return false;
+
+	timePoint = system_clock::from_time_t(static_cast<std::time_t>(epoch));
+	return true;
+}
+
+
+// sleep to within a couple of scheduler ticks of <deadline>, then spin
+static void waitUntil(ReplayClock::time_point deadline)
+{
+	const auto spinWindow = microseconds(2000);
+
+	auto now = ReplayClock::now();
+	if (deadline - now > spinWindow)
+		this_thread::sleep_until(deadline - spinWindow);
+
+	while (ReplayClock::now() < deadline)
+		this_thread::yield();
+}
+
+
+// raises the Windows timer resolution to 1 ms for the lifetime of the replay
+struct _TIMER_RESOLUTION
+{
+#ifdef _WIN32
+	_TIMER_RESOLUTION() { timeBeginPeriod(1); }
+	~_TIMER_RESOLUTION() { timeEndPeriod(1); }
+#endif
+};
+
+
+// paces the slices of one replay and keeps its statistics
+class _REPLAY_PACER
+{
+public:
+	_REPLAY_PACER(double speed, milliseconds maxIdle, seconds reportInterval) : speed(speed), maxIdle(maxIdle), reportInterval(reportInterval)
+	{
+		stats.targetSpeed = speed;
+		started = ReplayClock::now();
+		lastReport = started;
+	}
+
+	void deliver(const TimePoint& sliceTime, TradeStructVector& trades, const ReplayCallback& onSlice)
+	{
+		if (!bStarted)
+		{
+			firstSlice = sliceTime;
+			lastSlice = sliceTime;
+			bStarted = true;
+		}
+
+		// a gap that would idle longer than maxIdle is cut to it, so closed markets do not stall the replay
+		const double gap = duration<double>(sliceTime - lastSlice).count();
+		const double maxGap = duration<double>(maxIdle).count() * speed;
+		if (speed > 0.0 && gap > maxGap)
+			stats.skippedSeconds += gap - maxGap;
+		lastSlice = sliceTime;
+
+		const double offset = duration<double>(sliceTime - firstSlice).count() - stats.skippedSeconds;
+
+		if (speed > 0.0)
+		{
+			auto deadline = started + duration_cast<ReplayClock::duration>(duration<double>(offset / speed));
+			auto now = ReplayClock::now();
+
+			if (now < deadline)
+				waitUntil(deadline);
+			else
+				stats.maxLagSeconds = std::max(stats.maxLagSeconds, duration<double>(now - deadline).count());
+		}
+
+		const size_t count = trades.size();
+		onSlice(sliceTime, trades);
+
+		++stats.slices;
+		stats.trades += count;
+		stats.simulatedSeconds = offset;
+
+		auto now = ReplayClock::now();
+		if (now - lastReport >= reportInterval)
+		{
+			char timeStr[32] = { 0 };
+			time_t t = system_clock::to_time_t(sliceTime);
+			struct tm timeInfo;
+			localtime_s(&timeInfo, &t);
+			strftime(timeStr, sizeof(timeStr), "%F %T", &timeInfo);
+
+			double elapsed = duration<double>(now - started).count();
+			LOG_INFO << "Replay at " << timeStr << ": " << stats.trades << " trade(s), "
+				<< static_cast<long long>((stats.trades - lastTrades) / duration<double>(now - lastReport).count()) << " trades/s, "
+				<< offset / elapsed << "x";
+
+			lastReport = now;
+			lastTrades = stats.trades;
+		}
+	}
+
+	_REPLAY_STATS finish()
+	{
+		stats.wallSeconds = duration<double>(ReplayClock::now() - started).count();
+
+		LOG_INFO << "Replayed " << stats.slices << " slice(s), " << stats.trades << " trade(s): "
+			<< stats.simulatedSeconds << "s of market time in " << stats.wallSeconds << "s, "
+			<< (stats.skippedSeconds > 0.0 ? to_string(static_cast<long long>(stats.skippedSeconds)) + "s of gaps skipped, " : string())
+			<< stats.achievedSpeed() << "x achieved vs " << (speed > 0.0 ? to_string(speed) + "x" : string("max")) << " target, "
+			<< "max lag " << stats.maxLagSeconds * 1000.0 << " ms";
+
+		return stats;
+	}
+
+private:
+	double speed;
+	milliseconds maxIdle;
+	seconds reportInterval;
+	_TIMER_RESOLUTION resolution;
+	_REPLAY_STATS stats;
+
+	ReplayClock::time_point started;
+	ReplayClock::time_point lastReport;
+	size_t lastTrades = 0;
+	TimePoint firstSlice{};
+	TimePoint lastSlice{};
+	bool bStarted = false;
+};
+
+
+_REPLAY_STATS ReplayEngine::run(const Stock& stocks, const ReplayCallback& onSlice, seconds reportInterval)
+{
+	_REPLAY_PACER pacer(speed, maxIdle, reportInterval);
+
+	// the store is keyed by timestamp text, which sorts chronologically; slices that do not parse are skipped
+	size_t skipped = 0;
+	TradeStructVector trades;
+
+	for (const auto& slice : stocks)
+	{
+		TimePoint sliceTime;
+		if (!parseUtcTimestamp(slice.first, sliceTime))
+		{
+			++skipped;
+			continue;
+		}
+
+		trades.clear();
+		for (const auto& trade : slice.second)
+			trades.push_back(_TRADE{ get<0>(trade), get<2>(trade), sliceTime, get<1>(trade) });
+
+		pacer.deliver(sliceTime, trades, onSlice);
+	}
+
+	if (skipped > 0)
+		LOG_WARNING << "Replay skipped " << skipped << " slice(s) without a timestamp";
+
+	return pacer.finish();
+}
+
+
+_REPLAY_STATS ReplayEngine::run(ChunkedBarReader& reader, const ReplayCallback& onSlice, seconds reportInterval)
+{
+	_REPLAY_PACER pacer(speed, maxIdle, reportInterval);
+
+	// every bar is one trade of its volume at the open, as in the Stock store; a slice may span two chunks
+	TradeStructVector trades;
+	ChunkRowVector chunk;
+	long long sliceEpoch = LLONG_MIN;
+
+	while (reader.next(chunk))
+	{
+		for (const auto& row : chunk)
+		{
+			if (row.timestamp != sliceEpoch)
+			{
+				if (!trades.empty())
+					pacer.deliver(system_clock::from_time_t(static_cast<time_t>(sliceEpoch)), trades, onSlice);
+
+				trades.clear();
+				sliceEpoch = row.timestamp;
+			}
+
+			trades.push_back(_TRADE{ reader.symbols()[row.symbol], static_cast<int>(row.volume),
+				system_clock::from_time_t(static_cast<time_t>(row.timestamp)), row.open });
+		}
+	}
+
+	if (!trades.empty())
+		pacer.deliver(system_clock::from_time_t(static_cast<time_t>(sliceEpoch)), trades, onSlice);
+
+	if (reader.failed())
+		LOG_WARNING << "Replay read the partitions incompletely";
+
+	return pacer.finish();
+}
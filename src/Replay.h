@@ -0,0 +1,49 @@
+#pragma once
+#include <functional>
+#include <chrono>
+
+#include "Stock.h"
+#include "OutOfCore.h"
+
+// Replays the time ordered Stock store with the trades' original timestamps. Every timestamp of the
+// store is one slice; a slice is delivered when the wall clock reaches
+//
+//     replay start + (slice time - first slice time - gaps cut) / speed
+//
+// so 1 is real time, 60 replays an hour a minute and 0 delivers as fast as the callback allows.
+// Gaps longer than maxIdle of wall time, the nights and weekends the market is closed, are cut to
+// maxIdle and the schedule moves up by the rest. Waiting sleeps until shortly before the deadline and
+// spins the rest, for sub-millisecond pacing without tying up a core between slices.
+struct _REPLAY_STATS
+{
+	size_t slices = 0;
+	size_t trades = 0;
+	double simulatedSeconds = 0.0;			// market time replayed, without the gaps that were cut
+	double skippedSeconds = 0.0;			// market time cut from gaps longer than maxIdle
+	double wallSeconds = 0.0;
+	double maxLagSeconds = 0.0;			// latest delivery behind schedule, the callback could not keep up
+	double targetSpeed = 0.0;
+
+	double achievedSpeed() const { return wallSeconds > 0.0 ? simulatedSeconds / wallSeconds : 0.0; }
+};
+
+using ReplayCallback = std::function<void(const TimePoint& sliceTime, TradeStructVector& trades)>;
+
+class ReplayEngine
+{
+public:
+	explicit ReplayEngine(double speed = 1.0, std::chrono::milliseconds maxIdle = std::chrono::seconds(1)) : speed(speed), maxIdle(maxIdle) {}
+
+	// progress is reported through the log every reportInterval of wall time
+	_REPLAY_STATS run(const Stock& stocks, const ReplayCallback& onSlice, std::chrono::seconds reportInterval = std::chrono::seconds(5));
+
+	// replays the time ordered chunks of the Daily partitions, one slice per bar timestamp
+	_REPLAY_STATS run(ChunkedBarReader& reader, const ReplayCallback& onSlice, std::chrono::seconds reportInterval = std::chrono::seconds(5));
+
+private:
+	double speed;
+	std::chrono::milliseconds maxIdle;
+};
+
+// "2025-11-03 14:30:00" or "2025-11-03" as UTC, like the keys of the store; false when the text is not a timestamp
+bool parseUtcTimestamp(const std::string& text, TimePoint& timePoint);
@@ -0,0 +1,398 @@
+#include <fstream>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+#include "Resampler.h"
+#include "CsvBars.h"
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace fs = std::filesystem;
+
+// intervals worth keeping: 5m, 15m, 1h, 1d
+static const int CachedIntervals[] = { 5, 15, 60, 1440 };
+
+// Column reductions. Four independent accumulators break the dependency chain so each loop becomes
+// packed max/min/add instructions; the tail is folded into the first accumulator.
+static double maxOf(const double* p, size_t n)
+{
+	double m0 = p[0], m1 = p[0], m2 = p[0], m3 = p[0];
+	size_t k = 0;
+
+	for (; k + 4 <= n; k += 4)
+	{
+		m0 = m0 < p[k] ? p[k] : m0;
+		m1 = m1 < p[k + 1] ? p[k + 1] : m1;
+		m2 = m2 < p[k + 2] ? p[k + 2] : m2;
+		m3 = m3 < p[k + 3] ? p[k + 3] : m3;
+	}
+
+	for (; k < n; ++k)
+		m0 = m0 < p[k] ? p[k] : m0;
+
+	return std::max(std::max(m0, m1), std::max(m2, m3));
+}
+
+
+static double minOf(const double* p, size_t n)
+{
+	double m0 = p[0], m1 = p[0], m2 = p[0], m3 = p[0];
+	size_t k = 0;
+
+	for (; k + 4 <= n; k += 4)
+	{
+		m0 = p[k] < m0 ? p[k] : m0;
+		m1 = p[k + 1] < m1 ? p[k + 1] : m1;
+		m2 = p[k + 2] < m2 ? p[k + 2] : m2;
+		m3 = p[k + 3] < m3 ? p[k + 3] : m3;
+	}
+
+	for (; k < n; ++k)
+		m0 = p[k] < m0 ? p[k] : m0;
+
+	return std::min(std::min(m0, m1), std::min(m2, m3));
+}
+
+
+static long long sumOf(const long long* p, size_t n)
+{
+	long long s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	size_t k = 0;
+
+	for (; k + 4 <= n; k += 4)
+	{
+		s0 += p[k];
+		s1 += p[k + 1];
+		s2 += p[k + 2];
+		s3 += p[k + 3];
+	}
+
+	for (; k < n; ++k)
+		s0 += p[k];
+
+	return s0 + s1 + s2 + s3;
+}
+
+
+// start of the bucket holding <epoch>, also for times before 1970
+static long long bucketStart(long long epoch, long long width)
+{
+	long long r = epoch % width;
+	return epoch - (r < 0 ? r + width : r);
+}
+
+
+void resampleSeries(const _BAR_SERIES& in, int minutes, _BAR_SERIES& out)
+{
+	out = _BAR_SERIES();
+	if (in.empty() || minutes < 1)
+		return;
+
+	const long long width = static_cast<long long>(minutes) * 60;
+	const size_t n = in.size();
+	const long long* ts = in.timestamp.data();
+
+	// a 1 minute input gives roughly one output row per <minutes> input rows
+	out.reserve(n / static_cast<size_t>(minutes) + 2);
+
+	size_t first = 0;
+	while (first < n)
+	{
+		const long long start = bucketStart(ts[first], width);
+		const long long next = start + width;
+
+		// rows are sorted; short buckets are found faster by scanning than by bisecting
+		size_t last = first + 1;
+		while (last < n && ts[last] < next)
+			++last;
+
+		const size_t count = last - first;
+		out.timestamp.push_back(start);
+		out.open.push_back(in.open[first]);
+		out.high.push_back(maxOf(in.high.data() + first, count));
+		out.low.push_back(minOf(in.low.data() + first, count));
+		out.close.push_back(in.close[last - 1]);
+		out.volume.push_back(sumOf(in.volume.data() + first, count));
+
+		first = last;
+	}
+}
+
+
+ResampledBars resampleStore(const BarStore& store, int minutes, size_t workers)
+{
+	auto guard = store.lockShared();
+	const BarSeriesMap& source = store.series();
+
+	vector<pair<const string*, const _BAR_SERIES*>> work;
+	work.reserve(source.size());
+	for (const auto& entry : source)
+		work.emplace_back(&entry.first, &entry.second);
+
+	vector<_BAR_SERIES> results(work.size());
+
+	if (workers == 0)
+		workers = getThreadPool().size();
+	workers = std::min(workers, std::max<size_t>(work.size(), 1));
+
+	// symbols are handed out one at a time, so one long series does not hold up a whole slice of them
+	atomic<size_t> nextIndex{ 0 };
+	runWorkers(workers, [&]()
+	{
+		for (size_t i = nextIndex.fetch_add(1); i < work.size(); i = nextIndex.fetch_add(1))
+			resampleSeries(*work[i].second, minutes, results[i]);
+	});
+
+	auto resampled = make_shared<BarSeriesMap>();
+	for (size_t i = 0; i < work.size(); ++i)
+		resampled->emplace_hint(resampled->end(), *work[i].first, std::move(results[i]));
+
+	return resampled;
+}
+
+
+bool ResampleCache::isCached(int minutes)
+{
+	return std::find(begin(CachedIntervals), end(CachedIntervals), minutes) != end(CachedIntervals);
+}
+
+
+ResampledBars ResampleCache::get(int minutes)
+{
+	if (!isCached(minutes))
+		return resampleStore(store, minutes, workers);
+
+	const uint64_t version = store.version();
+	{
+		lock_guard<mutex> guard(lock);
+		auto itr = entries.find(minutes);
+		if (itr != entries.end() && itr->second.version == version)
+		{
+			++hitCount;
+			return itr->second.bars;
+		}
+		++missCount;
+	}
+
+	// computed outside the lock; when two callers race, both results are identical and the later one is kept
+	ResampledBars bars = resampleStore(store, minutes, workers);
+
+	lock_guard<mutex> guard(lock);
+	entries[minutes] = _ENTRY{ version, bars };
+	return bars;
+}
+
+
+static bool writeSeriesCSV(const fs::path& filename, const _BAR_SERIES& series)
+{
+	ofstream out(filename, ios::binary | ios::trunc);
+	if (!out)
+		return false;
+
+	string text(BarCsvHeader);
+	text.reserve(text.size() + series.size() * 64);
+
+	for (size_t i = 0; i < series.size(); ++i)
+		appendBarCSV(text, series.at(i));
+
+	out.write(text.data(), text.size());
+	return out.good();
+}
+
+
+bool resamplePartitions(const string& basePath, const vector<int>& minutes, size_t workers)
+{
+	BarStore store;
+	if (!store.loadPartitions(basePath))
+		return false;
+
+	ResampleCache cache(store, workers);
+	bool lOK = true;
+
+	for (int interval : minutes)
+	{
+		if (interval < 1)
+		{
+			LOG_WARNING << "Ignoring resample interval " << interval;
+			continue;
+		}
+
+		const size_t hits = cache.hits();
+		const auto started = steady_clock::now();
+		ResampledBars bars = cache.get(interval);
+		const double elapsed = duration<double>(steady_clock::now() - started).count();
+		const bool bCacheHit = cache.hits() > hits;
+
+		const string suffix = to_string(interval) + "m";
+		const fs::path folder = fs::path(basePath) / "Resampled" / suffix;
+
+		std::error_code ec;
+		fs::create_directories(folder, ec);
+
+		// one file per task, formatting and writing overlap across the pool
+		size_t rows = 0;
+		atomic<bool> failed{ false };
+		TaskGroup group;
+		for (const auto& entry : *bars)
+		{
+			rows += entry.second.size();
+			group.run([&folder, &suffix, &entry, &failed]()
+			{
+				const fs::path filename = folder / (entry.first + "_" + suffix + ".csv");
+				if (!writeSeriesCSV(filename, entry.second))
+				{
+					LOG_ERROR << "Cannot write " << filename.string();
+					failed.store(true, memory_order_relaxed);
+				}
+			});
+		}
+		group.wait();
+		lOK = lOK && !failed.load();
+
+		LOG_INFO << "Resampled " << store.rows() << " bar(s) to " << rows << " " << suffix << " bar(s) in "
+			<< elapsed * 1000.0 << " ms" << (bCacheHit ? " (cached)" : "");
+	}
+
+	return lOK;
+}
+
+
+// one interval of resamplePartitionsChunked(), per symbol its open bucket and the rows not written yet
+struct _CHUNKED_INTERVAL
+{
+	long long width;
+	string suffix;
+	fs::path folder;
+	vector<_BAR> open;						// timestamp LLONG_MIN = no bucket open
+	vector<string> pending;
+	vector<bool> bStarted;					// the file was created in this run
+	size_t rows = 0;
+};
+
+
+bool resamplePartitionsChunked(const string& basePath, const vector<int>& minutes, const _CHUNK_OPTIONS& options)
+{
+	const auto started = steady_clock::now();
+
+	// a quarter of the cap buffers output, the reader gets the rest
+	_CHUNK_OPTIONS readerOptions = options;
+	readerOptions.memoryCap = options.memoryCap / 4 * 3;
+	const size_t pendingCap = std::max<size_t>(options.memoryCap / 4, 1 << 16);
+
+	vector<_CHUNKED_INTERVAL> intervals;
+	for (int interval : minutes)
+	{
+		if (interval < 1)
+		{
+			LOG_WARNING << "Ignoring resample interval " << interval;
+			continue;
+		}
+
+		_CHUNKED_INTERVAL out;
+		out.width = static_cast<long long>(interval) * 60;
+		out.suffix = to_string(interval) + "m";
+		out.folder = fs::path(basePath) / "Resampled" / out.suffix;
+
+		std::error_code ec;
+		fs::create_directories(out.folder, ec);
+		intervals.push_back(std::move(out));
+	}
+
+	ChunkedBarReader reader(basePath, readerOptions);
+	bool lOK = true;
+	size_t pendingBytes = 0;
+
+	auto flush = [&](_CHUNKED_INTERVAL& out, size_t s)
+	{
+		if (out.pending[s].empty())
+			return;
+
+		const fs::path filename = out.folder / (reader.symbols()[s] + "_" + out.suffix + ".csv");
+		ofstream file(filename, ios::binary | (out.bStarted[s] ? ios::app : ios::trunc));
+		if (!out.bStarted[s])
+			file << BarCsvHeader;
+		file.write(out.pending[s].data(), out.pending[s].size());
+
+		if (!file.good())
+		{
+			LOG_ERROR << "Cannot write " << filename.string();
+			lOK = false;
+		}
+
+		out.bStarted[s] = true;
+		pendingBytes -= out.pending[s].size();
+		string().swap(out.pending[s]);
+	};
+
+	auto emit = [&](_CHUNKED_INTERVAL& out, size_t s)
+	{
+		const size_t before = out.pending[s].size();
+		appendBarCSV(out.pending[s], out.open[s]);
+		pendingBytes += out.pending[s].size() - before;
+		++out.rows;
+
+		// written a symbol at a time, so files are opened once per flush rather than once per row
+		if (pendingBytes > pendingCap)
+		{
+			for (auto& interval : intervals)
+				for (size_t i = 0; i < interval.pending.size(); ++i)
+					flush(interval, i);
+		}
+	};
+
+	ChunkRowVector chunk;
+	while (reader.next(chunk))
+	{
+		const size_t symbols = reader.symbols().size();
+
+		for (auto& out : intervals)
+		{
+			if (out.open.size() < symbols)
+			{
+				out.open.resize(symbols, _BAR{ LLONG_MIN, 0.0, 0.0, 0.0, 0.0, 0 });
+				out.pending.resize(symbols);
+				out.bStarted.resize(symbols, false);
+			}
+
+			for (const auto& row : chunk)
+			{
+				const long long start = bucketStart(row.timestamp, out.width);
+				_BAR& bar = out.open[row.symbol];
+
+				if (bar.timestamp != start)
+				{
+					if (bar.timestamp != LLONG_MIN)
+						emit(out, row.symbol);
+					bar = _BAR{ start, row.open, row.high, row.low, row.close, row.volume };
+					continue;
+				}
+
+				bar.high = std::max(bar.high, row.high);
+				bar.low = std::min(bar.low, row.low);
+				bar.close = row.close;
+				bar.volume += row.volume;
+			}
+		}
+	}
+
+	for (auto& out : intervals)
+	{
+		for (size_t s = 0; s < out.open.size(); ++s)
+		{
+			if (out.open[s].timestamp != LLONG_MIN)
+				emit(out, s);
+			flush(out, s);
+		}
+
+		LOG_INFO << "Resampled " << reader.rows() << " bar(s) to " << out.rows << " " << out.suffix << " bar(s)";
+	}
+
+	LOG_INFO << "Chunked resampling of " << reader.days() << " day(s) took " << duration<double>(steady_clock::now() - started).count() * 1000.0
+		<< " ms" << (reader.spilledRuns() > 0 ? ", " + to_string(reader.spilledRuns()) + " run(s) spilled" : string());
+
+	return lOK && !reader.failed();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "BarStore.h"
+#include "OutOfCore.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Resamples the 1 minute bars of a BarStore into N minute bars. Buckets are aligned to the UTC epoch,
+// so 60 gives clock hours and 1440 UTC days (a US session never crosses midnight UTC). A bucket's bar is
+// stamped with its start and reduces the rows inside it:
+//
+//   open = first open, high = max high, low = min low, close = last close, volume = sum volume
+//
+// Every reduction is a tight loop over one contiguous column with independent accumulators, so the
+// compiler keeps it in vector registers. Symbols are independent and are resampled in parallel.
+// Buckets without rows produce no bar.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+using ResampledBars = std::shared_ptr<const BarSeriesMap>;
+
+// resamples one series; minutes >= 1
+void resampleSeries(const _BAR_SERIES& in, int minutes, _BAR_SERIES& out);
+
+// resamples every symbol of <store> on <workers> workers of the shared thread pool, 0 = all of them
+ResampledBars resampleStore(const BarStore& store, int minutes, size_t workers = 0);
+
+// Keeps the resampled store for the common intervals until the underlying store changes; any other
+// interval is computed on every call.
+class ResampleCache
+{
+public:
+	explicit ResampleCache(const BarStore& store, size_t workers = 0) : store(store), workers(workers) {}
+
+	ResampledBars get(int minutes);
+
+	static bool isCached(int minutes);
+
+	size_t hits() const { return hitCount; }
+	size_t misses() const { return missCount; }
+
+private:
+	struct _ENTRY
+	{
+		uint64_t version;
+		ResampledBars bars;
+	};
+
+	const BarStore& store;
+	size_t workers;
+
+	std::mutex lock;
+	std::map<int, _ENTRY> entries;
+	size_t hitCount = 0;
+	size_t missCount = 0;
+};
+
+// loads the Daily partitions under <basePath> and writes Resampled/<N>m/<SYM>_<N>m.csv for every interval
+bool resamplePartitions(const std::string& basePath, const std::vector<int>& minutes, size_t workers = 0);
+
+// as resamplePartitions(), in one pass over the time ordered chunks of the partitions (see OutOfCore.h):
+// only every symbol's open bucket and the rows not yet written are held, within options.memoryCap
+bool resamplePartitionsChunked(const std::string& basePath, const std::vector<int>& minutes, const _CHUNK_OPTIONS& options);
@@ -0,0 +1,258 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "SharedSnapshot.h"
+#include "Indicators.h"
+#include "Log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// maps the named segment, creating it when <bCreate>; returns the view or nullptr
+static void* mapSegment(const string& name, bool bCreate, void*& mapping)
+{
+	const size_t size = sizeof(_SNAPSHOT_SEGMENT);
+	mapping = nullptr;
+
+#ifdef _WIN32
+	const string objectName = "Local\\" + name;
+	HANDLE hMapping = bCreate
+		? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, static_cast<DWORD>(size), objectName.c_str())
+		: OpenFileMappingA(FILE_MAP_READ, FALSE, objectName.c_str());
+	if (!hMapping)
+		return nullptr;
+
+	void* view = MapViewOfFile(hMapping, bCreate ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+	if (!view)
+	{
+		CloseHandle(hMapping);
+		return nullptr;
+	}
+
+	mapping = hMapping;
+	return view;
+#else
+	const string objectName = "/" + name;
+	int fd = bCreate ? shm_open(objectName.c_str(), O_CREAT | O_RDWR, 0644) : shm_open(objectName.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return nullptr;
+
+	if (bCreate && ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		::close(fd);
+		return nullptr;
+	}
+
+	void* view = mmap(nullptr, size, bCreate ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	return view == MAP_FAILED ? nullptr : view;
+#endif
+}
+
+
+SharedSnapshot::~SharedSnapshot()
+{
+	close();
+}
+
+
+bool SharedSnapshot::create(const string& segmentName)
+{
+	close();
+
+	void* view = mapSegment(segmentName, true, mapping);
+	if (!view)
+	{
+		LOG_ERROR << "Cannot create shared snapshot " << segmentName;
+		return false;
+	}
+
+	segment = static_cast<_SNAPSHOT_SEGMENT*>(view);
+	name = segmentName;
+	bOwner = true;
+
+	// readers check the layout fields before trusting the data; the sequence continues where an earlier
+	// run of the engine left it, made even in case that run stopped mid-update
+	uint64_t sequence = segment->sequence.load(memory_order_relaxed);
+	segment->sequence.store((sequence + 1) & ~uint64_t(1), memory_order_relaxed);
+	segment->magic = SnapshotMagic;
+	segment->version = SnapshotVersion;
+	segment->capacity = static_cast<uint32_t>(SnapshotCapacity);
+	segment->entrySize = static_cast<uint32_t>(sizeof(_SNAPSHOT_ENTRY));
+
+	LOG_INFO << "Publishing the top stocks in shared memory " << segmentName;
+	return true;
+}
+
+
+bool SharedSnapshot::open(const string& segmentName)
+{
+	close();
+
+	void* view = mapSegment(segmentName, false, mapping);
+	if (!view)
+		return false;
+
+	segment = static_cast<_SNAPSHOT_SEGMENT*>(view);
+	name = segmentName;
+	bOwner = false;
+
+	if (segment->magic != SnapshotMagic || segment->version != SnapshotVersion || segment->entrySize != sizeof(_SNAPSHOT_ENTRY))
+	{
+		LOG_ERROR << "Shared snapshot " << segmentName << " has an unknown layout";
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+
+void SharedSnapshot::close()
+{
+	if (!segment)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(segment);
+	CloseHandle(static_cast<HANDLE>(mapping));
+#else
+	munmap(segment, sizeof(_SNAPSHOT_SEGMENT));
+
+	// readers that already mapped the segment keep it; new readers can no longer find it
+	if (bOwner)
+		shm_unlink(("/" + name).c_str());
+#endif
+
+	segment = nullptr;
+	mapping = nullptr;
+}
+
+
+static int64_t toEpochNs(const TimePoint& t)
+{
+	return duration_cast<nanoseconds>(t.time_since_epoch()).count();
+}
+
+
+static void setIndicators(_SNAPSHOT_ENTRY& entry, const string& symbol, const IndicatorEngine* indicators)
+{
+	_INDICATOR_VALUES values{ NAN, NAN, NAN, NAN };
+	if (indicators)
+		indicators->get(symbol, values);
+
+	entry.indicators[SnapshotEMA] = values.ema;
+	entry.indicators[SnapshotVWAP] = values.vwap;
+	entry.indicators[SnapshotStdDev] = values.stdDev;
+	entry.indicators[SnapshotZVolume] = values.zVolume;
+}
+
+
+void SharedSnapshot::publish(const TopStockStruct& stocks, const TimePoint& asOf, int windowMinutes, const IndicatorEngine* indicators)
+{
+	if (!segment || !bOwner)
+		return;
+
+	// everything is prepared outside the critical section, which is then a single copy
+	vector<TopStockStruct::const_iterator> ranked;
+	ranked.reserve(stocks.size());
+	for (auto itr = stocks.begin(); itr != stocks.end(); ++itr)
+		ranked.push_back(itr);
+
+	std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a->second.totalShares > b->second.totalShares; });
+
+	const size_t count = std::min(ranked.size(), SnapshotCapacity);
+	long long total = 0;
+	for (size_t i = 0; i < count; ++i)
+		total += ranked[i]->second.totalShares;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto& stock = *ranked[i];
+		_SNAPSHOT_ENTRY& entry = staging.entries[i];
+
+		entry = _SNAPSHOT_ENTRY{};
+		entry.rank = static_cast<uint32_t>(i + 1);
+		entry.tradeCount = static_cast<uint32_t>(stock.second.trades.size());
+		memcpy(entry.symbol, stock.first.data(), std::min(stock.first.size(), SnapshotSymbolSize - 1));
+		entry.volume = stock.second.totalShares;
+		entry.volumeShare = total > 0 ? static_cast<double>(stock.second.totalShares) / static_cast<double>(total) : 0.0;
+
+		// trades are kept in arrival order
+		if (!stock.second.trades.empty())
+		{
+			entry.firstTradeNs = toEpochNs(stock.second.trades.front().second);
+			entry.lastTradeNs = toEpochNs(stock.second.trades.back().second);
+		}
+
+		setIndicators(entry, stock.first, indicators);
+	}
+
+	commit(count, asOf, windowMinutes);
+}
+
+
+void SharedSnapshot::publish(const _RANKED_STOCK* stocks, size_t count, const TimePoint& asOf, int windowMinutes, const IndicatorEngine* indicators)
+{
+	if (!segment || !bOwner)
+		return;
+
+	count = std::min(count, SnapshotCapacity);
+	long long total = 0;
+	for (size_t i = 0; i < count; ++i)
+		total += stocks[i].totalShares;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const _RANKED_STOCK& stock = stocks[i];
+		_SNAPSHOT_ENTRY& entry = staging.entries[i];
+
+		entry = _SNAPSHOT_ENTRY{};
+		entry.rank = static_cast<uint32_t>(i + 1);
+		entry.tradeCount = stock.tradeCount;
+		memcpy(entry.symbol, stock.stkSym, strnlen(stock.stkSym, SnapshotSymbolSize - 1));
+		entry.volume = stock.totalShares;
+		entry.volumeShare = total > 0 ? static_cast<double>(stock.totalShares) / static_cast<double>(total) : 0.0;
+		entry.firstTradeNs = toEpochNs(stock.firstTrade);
+		entry.lastTradeNs = toEpochNs(stock.lastTrade);
+
+		setIndicators(entry, stock.stkSym, indicators);
+	}
+
+	commit(count, asOf, windowMinutes);
+}
+
+
+void SharedSnapshot::commit(size_t count, const TimePoint& asOf, int windowMinutes)
+{
+	staging.timestampNs = toEpochNs(asOf);
+	staging.publishedNs = toEpochNs(system_clock::now());
+	staging.windowMinutes = static_cast<uint32_t>(windowMinutes);
+	staging.count = static_cast<uint32_t>(count);
+
+	const uint64_t sequence = segment->sequence.load(memory_order_relaxed);
+	segment->sequence.store(sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy(&segment->data, &staging, offsetof(_TOP_SNAPSHOT, entries) + count * sizeof(_SNAPSHOT_ENTRY));
+
+	segment->sequence.store(sequence + 2, memory_order_release);
+}
+
+
+SharedSnapshot& getSharedSnapshot()
+{
+	static SharedSnapshot snapshot;
+	return snapshot;
+}
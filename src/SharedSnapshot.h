@@ -0,0 +1,141 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <thread>
+
+#include "Stock.h"
+
+class IndicatorEngine;
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Top-N snapshot published in a named shared memory segment for other local processes (dashboards, risk
+// checks). The layout is fixed and versioned so readers only need this header.
+//
+// The segment is a seqlock: the writer makes <sequence> odd, copies the new snapshot in and makes it even
+// again. A reader copies the snapshot out between two reads of <sequence> and keeps the copy only when
+// both reads are the same even value. Readers never write to the segment, take no locks and make no
+// syscalls, so any number of them can poll it without slowing the engine down.
+//
+// Windows: named file mapping "Local\<name>"; elsewhere: POSIX shared memory "/<name>".
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+constexpr uint32_t SnapshotMagic = 0x31535454;		// "TTS1"
+constexpr uint32_t SnapshotVersion = 1;
+constexpr size_t SnapshotCapacity = 64;
+constexpr size_t SnapshotSymbolSize = 16;
+
+// indicators[] slots
+enum SnapshotIndicator { SnapshotEMA, SnapshotVWAP, SnapshotStdDev, SnapshotZVolume, SnapshotIndicatorCount };
+
+struct _SNAPSHOT_ENTRY
+{
+	uint32_t rank;									// 1 = highest volume
+	uint32_t tradeCount;							// trades inside the window
+	char symbol[SnapshotSymbolSize];				// NUL padded
+	int64_t volume;									// shares traded inside the window
+	double volumeShare;								// fraction of the listed symbols' combined volume
+	int64_t firstTradeNs;							// epoch nanoseconds
+	int64_t lastTradeNs;
+	double indicators[SnapshotIndicatorCount];		// NaN when not computed
+};
+
+struct _TOP_SNAPSHOT
+{
+	uint64_t sequence;								// update number, filled in by the reader
+	int64_t timestampNs;							// engine time the snapshot describes
+	int64_t publishedNs;							// wall clock time it was published
+	uint32_t windowMinutes;
+	uint32_t count;
+	_SNAPSHOT_ENTRY entries[SnapshotCapacity];
+};
+
+struct _SNAPSHOT_SEGMENT
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;
+	uint32_t entrySize;
+
+	alignas(64) std::atomic<uint64_t> sequence;		// odd while the writer is updating
+	alignas(64) _TOP_SNAPSHOT data;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the seqlock counter is shared between processes");
+
+// copies a consistent snapshot out of <segment>; false when the writer kept it busy for maxAttempts tries
+inline bool readSnapshot(const _SNAPSHOT_SEGMENT* segment, _TOP_SNAPSHOT& out, int maxAttempts = 1000)
+{
+	for (int attempt = 0; attempt < maxAttempts; ++attempt)
+	{
+		uint64_t before = segment->sequence.load(std::memory_order_acquire);
+		if (before & 1)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// count first, so a torn count cannot make the copy run past the array
+		uint32_t count = segment->data.count;
+		if (count > SnapshotCapacity)
+			count = SnapshotCapacity;
+
+		std::memcpy(&out, &segment->data, offsetof(_TOP_SNAPSHOT, entries) + count * sizeof(_SNAPSHOT_ENTRY));
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (segment->sequence.load(std::memory_order_relaxed) == before)
+		{
+			out.sequence = before / 2;
+			out.count = count;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+class SharedSnapshot
+{
+public:
+	SharedSnapshot() = default;
+	~SharedSnapshot();
+
+	SharedSnapshot(const SharedSnapshot&) = delete;
+	SharedSnapshot& operator=(const SharedSnapshot&) = delete;
+
+	// writer side: create (or take over) the segment
+	bool create(const std::string& name);
+
+	// reader side: map an existing segment read-only
+	bool open(const std::string& name);
+
+	void close();
+	bool isOpen() const { return segment != nullptr; }
+
+	// ranks <stocks> by volume and publishes the first SnapshotCapacity of them, with their indicators when given
+	void publish(const TopStockStruct& stocks, const TimePoint& asOf, int windowMinutes, const IndicatorEngine* indicators = nullptr);
+
+	// publishes a list already ranked by the fixed configuration engine, see FixedTickerTape.h
+	void publish(const _RANKED_STOCK* stocks, size_t count, const TimePoint& asOf, int windowMinutes, const IndicatorEngine* indicators = nullptr);
+
+	bool read(_TOP_SNAPSHOT& out) const { return segment && readSnapshot(segment, out); }
+
+	uint64_t updates() const { return segment ? segment->sequence.load(std::memory_order_relaxed) / 2 : 0; }
+
+private:
+	// copies the first <count> staged entries into the segment under the seqlock
+	void commit(size_t count, const TimePoint& asOf, int windowMinutes);
+
+	_SNAPSHOT_SEGMENT* segment = nullptr;
+	void* mapping = nullptr;
+	bool bOwner = false;
+	std::string name;
+
+	_TOP_SNAPSHOT staging{};
+};
+
+// the engine's segment
+SharedSnapshot& getSharedSnapshot();
@@ -5,6 +5,10 @@
 #include <vector>
 #include <chrono>
 #include <ctime>
+#include <cstdint>
+#include <future>
+
+#include "Log.h"
 
 constexpr char PathSeparator = static_cast<char>(std::filesystem::path::preferred_separator);
 
@@ -22,6 +26,7 @@ struct _TRADE
 	std::string stkSym;
 	int numShares;
 	TimePoint transTime;
+	double price = 0.0;
 };
 
 using TradeStructVector = std::vector<_TRADE>;
@@ -62,6 +67,30 @@ struct _TOP_STOCK
 using TopStockStruct = std::map<std::string, _TOP_STOCK>;
 using TopStockStructItr = TopStockStruct::iterator;
 
+// one row of a ranked top N list from the fixed configuration engine, see FixedTickerTape.h
+struct _RANKED_STOCK
+{
+	char stkSym[16];						// NUL terminated
+	long long totalShares;
+	uint32_t tradeCount;
+	TimePoint firstTrade;					// to the engine's bucket resolution
+	TimePoint lastTrade;
+};
+
+// one OHLCV row of a downloaded time series, timestamp in UTC epoch seconds
+struct _BAR
+{
+	long long timestamp;
+	double open;
+	double high;
+	double low;
+	double close;
+	long long volume;
+};
+
+using BarVector = std::vector<_BAR>;
+using BarVectorItr = BarVector::iterator;
+
 struct OutputTarget
 {
 	std::string jsonFilename;
@@ -97,10 +126,17 @@ inline bool any(SaveType a)
 
 enum class WindowType { Console, Graphical, ThreeD };
 
+// HTTP record/replay, see Cassette.h
+enum class CassetteMode { Off, Record, Replay };
+
+// live trade stream wire format, see Stream.h
+enum class StreamFraming { Line, Binary };
+
 struct _TICKER_TAPE_ARGS
 {
 	bool bInteractive = true;
-	bool bCleanApp = true;
+	bool bCleanApp = false;		// wipes the output tree and its manifest, normally only missing days are fetched
+	LogLevel logLevel = LogLevel::Info;	// Debug also logs every request URL and response payload
 	std::string path;
 	std::string start = "11/01/2025";
 	std::string end = "12/20/2025";
@@ -110,6 +146,82 @@ struct _TICKER_TAPE_ARGS
 	std::string combinedStocksFilename = "CombinedStocks.csv";
 	std::string parseStocksFilename = "CombinedStocks.csv";
 
+	// download into Daily partitions only and derive Weekly/Monthly/Yearly/Single by compaction
+	bool bDeriveRollups = true;
+	bool bCompactInBackground = true;
+
+	// Yahoo chart endpoint, may point at a local stand-in server for offline runs
+	std::string yahooBaseURL = "https://query1.finance.yahoo.com";
+	size_t maxConcurrentDownloads = 8;
+
+	// stand-in chart server, see ChartServer.h: /ServeYahoo=<endpoint> runs it, /CheckDownload runs the engine against it
+	std::string chartServerEndpoint;
+	int chartServerLatencyMs = 0;			// added to every response
+	std::string checkDownloadEndpoint;
+
+	// download pipeline: responses buffered between fetch/decode/persist stages, and decode threads
+	size_t pipelineQueueCapacity = 32;
+	size_t decodeWorkers = 2;
+
+	// token bucket limits per provider, Alpha Vantage documents 5 requests per minute on the free tier
+	double yahooRequestsPerSecond = 4.0;
+	double yahooBurst = 8.0;
+	double alphaVantageRequestsPerMinute = 5.0;
+
+	// record responses to, or replay them from, <path>/<cassetteFolder> with optional injected latency/errors
+	CassetteMode cassetteMode = CassetteMode::Off;
+	std::string cassetteFolder = "Cassette";
+	int cassetteLatencyMs = 0;
+	double cassetteErrorRate = 0.0;
+	long cassetteErrorCode = 429;
+
+	// live streaming, see Stream.h: /Stream=<endpoint> ingests trades, /Publish=<endpoint> runs the stand-in publisher
+	std::string streamEndpoint;
+	std::string publishEndpoint;
+	StreamFraming streamFraming = StreamFraming::Line;
+	size_t streamBatchSize = 4096;			// trades handed to TickerTape() at once
+	int streamBatchDelayMs = 5;				// longest a received trade waits for its batch to fill
+	double publishRate = 10000.0;			// trades per second, 0 = as fast as possible
+	size_t publishCount = 0;				// 0 = until the subscriber disconnects
+
+	// shared memory segment the top stocks are published in, see SharedSnapshot.h; empty disables it
+	std::string snapshotName = "TickerTapeTopN";
+	bool bWatchSnapshot = false;			// /Watch: print another engine's snapshot instead of running one
+
+	// replay of the downloaded dataset, see Replay.h: 1 = real time, 60 = an hour a minute, 0 = as fast as possible
+	double replaySpeed = 60.0;
+	int replayMaxIdleMs = 1000;				// longest wait between two slices, closed market hours are cut to it
+
+	// rolling indicators published with the top stocks, see Indicators.h
+	size_t indicatorWindow = 20;			// 1 minute bars in the VWAP, stddev and volume z-score window
+	size_t emaPeriod = 20;
+
+	// N minute bars resampled from the Daily partitions after the download, see Resampler.h; empty disables it
+	std::vector<int> resampleMinutes;
+	size_t resampleWorkers = 0;				// 0 = one per core
+
+	// /Top=<from>,<to>[,<n>]: the n symbols with the most volume in [from, to) of the partitions, see VolumeIndex.h
+	std::string topFrom;
+	std::string topTo;
+	size_t topCount = 10;
+
+	// /Correlation=<from>,<to>: minute return correlation matrix of every symbol in the range, see Correlation.h
+	std::string correlationFrom;
+	std::string correlationTo;
+
+	// Yahoo and Alpha Vantage Daily partitions merged into <path>/Merged after the download, see MergeSources.h;
+	// where both have a minute the source listed first wins
+	bool bMergeSources = true;
+	std::vector<std::string> sourcePriority = { "Yahoo", "AlphaVantage" };
+
+	// /Engine=fixed ranks with the compile time configured LiveTickerTape (see FixedTickerTape.h) instead of TickerTape()
+	bool bFixedEngine = false;
+
+	// /MemoryCap=<MB> runs replay, resampling and the combined export over time ordered chunks of the Daily
+	// partitions instead of the in-memory Stock store, spilling to <path>/<spillFolder>; 0 = in memory, see OutOfCore.h
+	size_t memoryCapMB = 0;
+	std::string spillFolder = "Spill";
+
 	WindowType windowTypes[];
 
 	_TICKER_TAPE_ARGS() { }
@@ -124,6 +236,10 @@ bool downloadDataset
 	SaveType saveType
 );
 
+// compaction prototypes
+bool compactPartitions(const std::string& basePath, SaveType saveType, bool bIncremental = true);
+std::future<bool> compactPartitionsAsync(const std::string& basePath, SaveType saveType, bool bIncremental = true);
+
 // general prototypes
 void clearScreen();
 std::string trim(const std::string& s);
@@ -133,6 +249,8 @@ std::string getDownloadFolder();
 std::time_t parseDateToEpoch(const std::string& mmddyyyy);
 
 std::string epoch_to_utc_string(long epoch);
+bool utc_string_to_epoch(const std::string& text, long long& epoch);
+long long daysFromCivil(int year, int month, int day);
 
 bool timePointToLocalTm(const TimePoint& tp, std::tm& outLocalTm);
 std::pair<long long, long long> computeLocalDayEpochRange(const TimePoint& tp);
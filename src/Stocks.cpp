@@ -5,14 +5,33 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <tuple>
 #include <algorithm>
 #include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <climits>
+#include <atomic>
+#include <mutex>
 
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
 
 #include "Stock.h"
+#include "AsyncWriter.h"
+#include "BatchWriter.h"
+#include "Download.h"
+#include "RateLimiter.h"
+#include "RangePlanner.h"
+#include "Cassette.h"
+#include "Manifest.h"
+#include "Pipeline.h"
+#include "Log.h"
+#include "CsvBars.h"
+#include "Resampler.h"
+#include "MergeSources.h"
+#include "OutOfCore.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -62,10 +81,10 @@ static string GlobalQuotePrefix = "https://www.alphavantage.co/query?function=GL
 static string GlobalQuoteSuffix = "&interval=1min&outputsize=full&datatype=json&apikey=" + apiKey;
 
 static string TimeSeriesDailyPrefix = "https://www.alphavantage.co/query?function=TIME_SERIES_DAILY&symbol=";
-static string TimeSeriesDailySuffix = "&interval=1min&datatype=json&apikey=" + apiKey;
+static string TimeSeriesDailySuffix = "&interval=1min&datatype=csv&apikey=" + apiKey;
 
 static string TimeSeriesIntradayPrefix = "https://www.alphavantage.co/query?function=TIME_SERIES_INTRADAY&symbol=";
-static string TimeSeriesIntradaySuffix = "&interval=1min&datatype=json&apikey=" + apiKey;
+static string TimeSeriesIntradaySuffix = "&interval=1min&datatype=csv&apikey=" + apiKey;
 
 
 static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp)
@@ -85,40 +104,68 @@ static CURLcode downloadURL(CURL* curl, string url)
 }
 
 
-static long fetch_with_backoff(CURL* curl, const string& url, string& downloadBuffer, int maxRetries = 6)
+// Alpha Vantage answers an exhausted quota with HTTP 200 and a short "Note"/"Information" message
+static bool isAlphaVantageThrottled(const string& body)
 {
+	return body.size() < 1024 && (body.find("\"Note\"") != string::npos || body.find("\"Information\"") != string::npos);
+}
+
+
+static long fetch_with_backoff(CURL* curl, const string& url, string& downloadBuffer, const string& provider = YahooProvider, int maxRetries = 6)
+{
+	RateScheduler& scheduler = getRateScheduler();
+	Cassette& cassette = getCassette();
 	int attempt = 0;
 	long http_code = 0;
 	
 	while (attempt <= maxRetries)
 	{
+		// pace through the provider's token bucket instead of fixed sleeps
+		scheduler.acquire(provider);
+
 		downloadBuffer.clear();
-		CURLcode res = downloadURL(curl, url);
+		curl_off_t retryAfter = 0;
 
-		if (res != CURLE_OK)
+		if (cassette.replaying())
 		{
-			std::cerr << "curl error: " << curl_easy_strerror(res) << endl;
-			std::this_thread::sleep_for(std::chrono::seconds(2 << attempt));
-			++attempt;
-			continue;
+			// offline: answer from the recorded responses, no network involved
+			std::this_thread::sleep_for(cassette.latency());
+			cassette.replay(url, http_code, downloadBuffer);
 		}
-		
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+		else
+		{
+			CURLcode res = downloadURL(curl, url);
+
+			if (res != CURLE_OK)
+			{
+				LOG_WARNING << "curl error: " << curl_easy_strerror(res) << ", retrying " << url;
+				std::this_thread::sleep_for(std::chrono::seconds(2 << attempt));
+				++attempt;
+				continue;
+			}
+			
+			curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+			curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retryAfter);
+			cassette.record(url, http_code, downloadBuffer);
+		}
+
+		if (http_code == 200 && provider == AlphaVantageProvider && isAlphaVantageThrottled(downloadBuffer))
+			http_code = 429;
+
+		scheduler.onResponse(provider, http_code, static_cast<long long>(retryAfter));
 
 		if (http_code == 200) return http_code;
 		
 		if (http_code == 429)
 		{
-			// exponential backoff
-			int wait = (1 << attempt) * 2; // 2,4,8...
-			std::cerr << "429 received, backing off " << wait << "s" << endl;
-			std::this_thread::sleep_for(std::chrono::seconds(wait));
+			// the scheduler holds the provider back for Retry-After or an exponential backoff
+			LOG_WARNING << "429 received from " << provider << ", retry " << attempt + 1 << " of " << maxRetries;
 			++attempt;
 			continue;
 		}
 		
 		// other non-200 codes: break and return
-		std::cerr << "HTTP code: " << http_code << endl;
+		LOG_ERROR << "HTTP code: " << http_code;
 		return http_code;
 	}
 	
@@ -126,35 +173,181 @@ static long fetch_with_backoff(CURL* curl, const string& url, string& downloadBu
 }
 
 
+static bool parseYahooBars(const string& jsonText, BarVector& bars)
+{
+	bars.clear();
+
+	json j = json::parse(jsonText, nullptr, false);
+	if (j.is_discarded()) return false;
+
+	auto& result = j["chart"]["result"];
+	if (!result.is_array() || result.empty()) return false;
+
+	auto& timestamps = result[0]["timestamp"];
+	auto& quote = result[0]["indicators"]["quote"][0];
+	if (!timestamps.is_array()) return true;
+
+	auto& opens = quote["open"];
+	auto& highs = quote["high"];
+	auto& lows = quote["low"];
+	auto& closes = quote["close"];
+	auto& volumes = quote["volume"];
+
+	bars.reserve(timestamps.size());
+
+	for (size_t i = 0; i < timestamps.size(); ++i)
+	{
+		if (timestamps[i].is_null()) continue;
+
+		_BAR bar;
+		bar.timestamp = timestamps[i].get<long long>();
+		bar.open = opens[i].is_null() ? NAN : opens[i].get<double>();
+		bar.high = highs[i].is_null() ? NAN : highs[i].get<double>();
+		bar.low = lows[i].is_null() ? NAN : lows[i].get<double>();
+		bar.close = closes[i].is_null() ? NAN : closes[i].get<double>();
+		bar.volume = volumes[i].is_null() ? 0 : volumes[i].get<long long>();
+		bars.push_back(bar);
+	}
+
+	return true;
+}
+
+
+// formats the rows [first, last); returns the row count
+static size_t formatBarsCSV(BarVector::const_iterator first, BarVector::const_iterator last, string& out)
+{
+	out.clear();
+	out.reserve(static_cast<size_t>(last - first) * 64);
+
+	for (auto itr = first; itr != last; ++itr)
+		appendBarCSV(out, *itr);
+
+	return static_cast<size_t>(last - first);
+}
+
+
+// the rows of time ordered <bars> with timestamps in [period1, period2)
+static pair<BarVector::const_iterator, BarVector::const_iterator> sliceBars(const BarVector& bars, long long period1, long long period2)
+{
+	auto before = [](const _BAR& bar, long long t) { return bar.timestamp < t; };
+	auto first = std::lower_bound(bars.begin(), bars.end(), period1, before);
+	return { first, std::lower_bound(first, bars.end(), period2, before) };
+}
+
+
+// one Daily partition cut out of a response
+struct _DAY_ROWS
+{
+	size_t dayIndex;
+	size_t rows;
+	shared_ptr<const string> csv;
+};
+
+// a response after the decode stage, ready to be persisted
+struct _DECODED_RESPONSE
+{
+	size_t tag;
+	shared_ptr<const string> json;
+	vector<_DAY_ROWS> days;
+};
+
+
+// Parses a response once into a row batch and formats one CSV block per day it covers.
+static bool decodeYahooResponse(const _RANGE_REQUEST& request, _DOWNLOAD_RESULT& result, BarVector& rows, _DECODED_RESPONSE& decoded)
+{
+	if (!parseYahooBars(result.body, rows))
+		return false;
+
+	decoded.tag = result.tag;
+	// the response stays in its receive buffer until persisted, then the buffer goes back to the pool
+	decoded.json = getBufferPool().share(std::move(result.body));
+	decoded.days.clear();
+
+	// Yahoo sends the rows in time order; each day is then cut out by bisection instead of a scan of the batch
+	auto earlier = [](const _BAR& a, const _BAR& b) { return a.timestamp < b.timestamp; };
+	if (!std::is_sorted(rows.begin(), rows.end(), earlier))
+		std::stable_sort(rows.begin(), rows.end(), earlier);
+
+	for (size_t i = 0; i < request.days.size(); ++i)
+	{
+		auto [first, last] = sliceBars(rows, request.days[i].period1, request.days[i].period2);
+
+		string csvBuffer;
+		size_t count = formatBarsCSV(first, last, csvBuffer);
+		decoded.days.push_back(_DAY_ROWS{ i, count, make_shared<const string>(std::move(csvBuffer)) });
+	}
+
+	return true;
+}
+
+
+// Fans decoded partitions out to every enabled SaveType target, written in batches by BatchFileWriter.
+struct _MULTI_SINK_WRITER
+{
+	BatchFileWriter files;
+
+	static const shared_ptr<const string>& csvHeader()
+	{
+		static const auto header = make_shared<const string>(BarCsvHeader);
+		return header;
+	}
+
+	// Write the rows to the CSV of every target, and the response to its JSON when given. Every target
+	// is one day, so a refetched day replaces its file instead of growing it.
+	void write(const vector<OutputTarget>& targets, const shared_ptr<const string>& json, const shared_ptr<const string>& csv)
+	{
+		for (const auto& out : targets)
+		{
+			if (json)
+				files.queue(out.jsonFilename, json, false);
+
+			files.queue(out.csvFilename, csv, false, csvHeader());
+		}
+
+		if (files.pending() >= 256)
+			flush();
+	}
+
+	// Write only the response to the JSON of every target, for levels whose CSV is derived by compaction.
+	void writeJSON(const vector<OutputTarget>& targets, const shared_ptr<const string>& json)
+	{
+		for (const auto& out : targets)
+			files.queue(out.jsonFilename, json, false);
+	}
+
+	bool flush()
+	{
+		if (!files.flush())
+		{
+			LOG_ERROR << "Some output files could not be written";
+			return false;
+		}
+
+		return true;
+	}
+};
+
+
 static void yahoo_json_to_csv(const string& jsonText, const string& outFilename)
 {
-	json j = json::parse(jsonText);
-	auto& result = j["chart"]["result"][0];
-	auto timestamps = result["timestamp"];
-	auto quote = result["indicators"]["quote"][0];
+	BarVector bars;
+	string csvBuffer;
 
-	ofstream ofs(outFilename, std::ios::app);
-	if (!ofs)
+	if (!parseYahooBars(jsonText, bars))
 	{
-		std::cerr << "Cannot open " << outFilename << endl;
+		LOG_ERROR << "Cannot parse response for " << outFilename;
 		return;
 	}
-	
-	for (size_t i = 0; i < timestamps.size(); ++i)
-	{
-		if (timestamps[i].is_null()) continue;
 
-		long ts = timestamps[i].get<long>();
-		double open = quote["open"][i].is_null() ? NAN : quote["open"][i].get<double>();
-		double high = quote["high"][i].is_null() ? NAN : quote["high"][i].get<double>();
-		double low = quote["low"][i].is_null() ? NAN : quote["low"][i].get<double>();
-		double close = quote["close"][i].is_null() ? NAN : quote["close"][i].get<double>();
-		long volume = quote["volume"][i].is_null() ? 0 : quote["volume"][i].get<long>();
-		
-		ofs << epoch_to_utc_string(ts) << "," << open << "," << high << "," << low << "," << close << "," << volume << endl;
+	ofstream ofs(outFilename, std::ios::binary | std::ios::app);
+	if (!ofs)
+	{
+		LOG_ERROR << "Cannot open " << outFilename;
+		return;
 	}
-	
-	ofs.close();
+
+	formatBarsCSV(bars.cbegin(), bars.cend(), csvBuffer);
+	ofs.write(csvBuffer.data(), csvBuffer.size());
 }
 
 
@@ -185,13 +378,14 @@ static vector<std::pair<long long, long long>> computeDailyRanges(const TimePoin
 
 static string buildYahooURL
 (
+	const string& baseURL,
 	const string& symbol,
 	long long p1,
 	long long p2,
 	const string& interval = "1m"
 )
 {
-	return "https://query1.finance.yahoo.com/v8/finance/chart/"
+	return baseURL + "/v8/finance/chart/"
 		+ symbol
 		+ "?period1=" + std::to_string(p1)
 		+ "&period2=" + std::to_string(p2)
@@ -283,8 +477,6 @@ static vector<OutputTarget> makeOutputFilenames
 
 static void downloadYahoo
 (
-	CURL* curl,
-	string& downloadBuffer,
 	Stock& stocks,
 	map<string, string>& symbols,
 	_TICKER_TAPE_ARGS& args,
@@ -313,51 +505,176 @@ static void downloadYahoo
 	TimePoint start = parse_mmddyyyy(args.start);
 	TimePoint end = parse_mmddyyyy(args.end);
 
-	auto ranges = computeDailyRanges(start, end);
+	_MULTI_SINK_WRITER writer;
+	DownloadEngine engine(args.maxConcurrentDownloads, YahooProvider);
+
+	// trading days only, packed into as few requests as the provider's limits allow
+	// replays plan as if run right after the end date, so the same requests come out on any later day
+	TimePoint planningTime = getCassette().replaying() ? end + hours(24) : system_clock::now();
+	const long long fetchTime = static_cast<long long>(system_clock::to_time_t(planningTime));
 
-	for (auto& sym : symbols)
+	// only symbol-days missing from the manifest, or still open when they were fetched, are requested
+	PartitionManifest manifest;
+	const string manifestFilename = args.path + PathSeparator + "Daily" + PathSeparator + "partitions.manifest";
+	if (manifest.load(manifestFilename))
+		LOG_INFO << "Manifest " << manifestFilename << ": " << manifest.size() << " partition(s)";
+
+	RangeRequestVector requests = planRangeRequests
+	(
+		symbols, start, end, planningTime, YahooMaxDaysPerRequest, YahooLookbackDays,
+		[&manifest](const string& symbol, const _TRADING_DAY& day) { return !manifest.isComplete(symbol, day.date, "1m"); }
+	);
+
+	for (size_t i = 0; i < requests.size(); ++i)
+	{
+		string url = buildYahooURL(args.yahooBaseURL, requests[i].symbol, requests[i].period1, requests[i].period2, "1m");
+		LOG_DEBUG << url;
+
+		// the tag indexes back into the request list
+		engine.add(url, i);
+	}
+
+	// fetch -> decode -> persist on separate threads, the bounded queues between them cap memory use
+	BoundedQueue<_DOWNLOAD_RESULT> fetched(args.pipelineQueueCapacity);
+	BoundedQueue<_DECODED_RESPONSE> decoded(args.pipelineQueueCapacity);
+	_STAGE_STATS fetchStats{ "fetch" };
+	_STAGE_STATS decodeStats{ "decode" };
+	_STAGE_STATS persistStats{ "persist" };
+
+	std::thread fetcher([&]()
 	{
-		const string& symbol = sym.first;
+		// the fetch stage counts as busy unless it is blocked by a full decode queue
+		PipelineClock::duration blocked{ 0 };
+		fetchStats.begin();
 
-		for (size_t i = 0; i < ranges.size(); ++i)
+		engine.run([&](_DOWNLOAD_RESULT& result)
 		{
-			auto [p1, p2] = ranges[i];
+			auto t = PipelineClock::now();
+			fetched.push(std::move(result));
+			blocked += PipelineClock::now() - t;
+			++fetchStats.items;
+		});
+
+		fetchStats.end();
+		fetchStats.busy = (fetchStats.stopped - fetchStats.started) - blocked;
+		fetched.close();
+	});
+
+	// responses are decoded in whatever order they arrive
+	std::atomic<size_t> decodersRunning{ std::max<size_t>(args.decodeWorkers, 1) };
+	std::mutex decodeStatsLock;
+	vector<std::thread> decoders;
+	decodeStats.workers = decodersRunning.load();
+	decodeStats.begin();
+
+	for (size_t w = 0; w < decodersRunning.load(); ++w)
+	{
+		decoders.emplace_back([&]()
+		{
+			BarVector rows;
+			_DOWNLOAD_RESULT result;
+
+			while (fetched.pop(result))
+			{
+				auto t = PipelineClock::now();
+				const _RANGE_REQUEST& request = requests[result.tag];
+				LOG_DEBUG << result.body;
 
-			string url = buildYahooURL(symbol, p1, p2, "1m");
-			cout << url << endl;
+				_DECODED_RESPONSE response;
+				bool bDecoded = false;
+
+				if (result.httpCode != 200 || result.body.empty())
+					LOG_ERROR << "Failed: " << request.symbol << " " << request.days.size() << " day(s) from " << request.period1 << " HTTP code: " << result.httpCode;
+				else if (!(bDecoded = decodeYahooResponse(request, result, rows, response)))
+					LOG_ERROR << "Failed to parse: " << request.symbol << " " << request.days.size() << " day(s) from " << request.period1;
+
+				{
+					lock_guard<mutex> guard(decodeStatsLock);
+					decodeStats.addBusy(t);
+				}
 
-			long code = fetch_with_backoff(curl, url, downloadBuffer);
-			cout << downloadBuffer << endl;
+				if (bDecoded)
+					decoded.push(std::move(response));
+				else
+					getBufferPool().release(std::move(result.body));
+			}
 
-			if (code != 200 || downloadBuffer.empty())
+			if (--decodersRunning == 0)
 			{
-				std::cerr << "Failed: " << symbol << " day " << i << std::endl;
-				continue;
+				decodeStats.end();
+				decoded.close();
 			}
+		});
+	}
 
-			TimePoint day = start + std::chrono::hours(24 * i);
+	// the persist stage runs on this thread
+	_DECODED_RESPONSE response;
+	persistStats.begin();
 
-			//auto [jsonFilename, csvFilename] = makeOutputFilenames(args.path, symbol, day, saveType);
-			auto filenames = makeOutputFilenames(args.path, symbol, day, saveType);
+	while (decoded.pop(response))
+	{
+		auto t = PipelineClock::now();
+		const _RANGE_REQUEST& request = requests[response.tag];
 
-			for (const auto& out : filenames)
-			{
-				ofstream jsonFile(out.jsonFilename);
-				jsonFile << downloadBuffer;
-				jsonFile.close();
-				cout << "Saved JSON: " << out.jsonFilename << endl;
+		// Daily is the source of truth, the CSV of coarser levels is derived from it by compactPartitions(),
+		// their JSON is still the raw response
+		SaveType writeTypes = args.bDeriveRollups ? SaveType::DailyFile : saveType;
+		SaveType jsonTypes = args.bDeriveRollups ? saveType & (SaveType::WeeklyFile | SaveType::MonthlyFile | SaveType::YearlyFile | SaveType::SingleFile) : SaveType::None;
 
-				bool exists = std::filesystem::exists(out.csvFilename);
-				if (!exists)
-				{
-					ofstream hdr(out.csvFilename);
-					hdr << "timestamp,open,high,low,close,volume\n";
-				}
+		// the raw response is kept once, next to the first day it covers and named after the whole range
+		shared_ptr<const string> json = response.json;
 
-				yahoo_json_to_csv(downloadBuffer, out.csvFilename);
+		for (const auto& dayRows : response.days)
+		{
+			const _TRADING_DAY& day = request.days[dayRows.dayIndex];
+			auto filenames = makeOutputFilenames(args.path, request.symbol, day.day, writeTypes);
+			auto jsonFilenames = json ? makeOutputFilenames(args.path, request.symbol, day.day, jsonTypes) : vector<OutputTarget>();
+
+			if (json && request.days.size() > 1)
+			{
+				for (auto& out : filenames)
+					out.jsonFilename.insert(out.jsonFilename.size() - 5, "_" + request.days.back().date);
+				for (auto& out : jsonFilenames)
+					out.jsonFilename.insert(out.jsonFilename.size() - 5, "_" + request.days.back().date);
 			}
+
+			writer.write(filenames, json, dayRows.csv);
+			if (json)
+				writer.writeJSON(jsonFilenames, json);
+			json.reset();
+
+			if (filenames.empty())
+				continue;
+
+			_PARTITION_STATE state;
+			state.symbol = request.symbol;
+			state.date = day.date;
+			state.interval = "1m";
+			state.rows = static_cast<long long>(dayRows.rows);
+			state.bytes = writer.csvHeader()->size() + dayRows.csv->size();
+			state.checksum = PartitionManifest::checksum(*dayRows.csv);
+			state.bComplete = day.period2 <= fetchTime;
+			state.csvFilename = filenames.front().csvFilename;
+			manifest.update(state);
 		}
+
+		persistStats.addBusy(t);
 	}
+
+	fetcher.join();
+	for (auto& decoder : decoders)
+		decoder.join();
+
+	writer.flush();
+	persistStats.end();
+
+	LOG_INFO << "Yahoo Finance pipeline:";
+	fetchStats.report(&fetched);
+	decodeStats.report(&decoded);
+	persistStats.report<int>(nullptr);
+
+	if (!manifest.save())
+		LOG_ERROR << "Cannot write " << manifestFilename;
 }
 
 
@@ -389,11 +706,11 @@ static void downloadYahooOld
 			       + "&period2=" + to_string(static_cast<long long>(t2)) //std::to_string(period2)
 			       + "&interval=1m&events=history&includeAdjustedClose=true";
 
-		cout << url << endl;
+		LOG_DEBUG << url;
 
 		long code = fetch_with_backoff(curl, url, downloadBuffer);
 
-		cout << downloadBuffer << endl;
+		LOG_DEBUG << downloadBuffer;
 
 		if (code == 200 && !downloadBuffer.empty())
 		{
@@ -402,7 +719,7 @@ static void downloadYahooOld
 			ofstream jsonFile(jsonFilename);
 			jsonFile << downloadBuffer;
 			jsonFile.close();
-			cout << "Saved JSON: " << jsonFilename << endl;
+			LOG_DEBUG << "Saved JSON: " << jsonFilename;
 
 			// Convert to Comma Separator Values (CSV)
 			string csvFilename(args.path + PathSeparator + symbol.first + "_1m_7d.csv");
@@ -421,11 +738,11 @@ static void downloadYahooOld
 			
 			yahoo_json_to_csv(downloadBuffer, csvFilename);
 			
-			cout << "Saved CSV: " << csvFilename << endl;
+			LOG_DEBUG << "Saved CSV: " << csvFilename;
 		}
 		else
 		{
-			std::cerr << "Failed to fetch data, HTTP code: " << code << endl;
+			LOG_ERROR << "Failed to fetch data, HTTP code: " << code;
 		}
 	}
 }
@@ -440,13 +757,13 @@ static void downloadListingStatus
 {
 	// LISTING_STATUS
 	string url = ListingStatusPrefix + ListingStatusSuffix;
-	downloadBuffer.clear();
-	cout << url << endl;
-
-	CURLcode res = downloadURL(curl, url);
-	cout << url << ": " << endl << downloadBuffer << endl;
+	LOG_DEBUG << url;
 
-	this_thread::sleep_until(chrono::system_clock::now() + chrono::seconds(10));
+	long code = fetch_with_backoff(curl, url, downloadBuffer, AlphaVantageProvider);
+	if (code == 200)
+		LOG_DEBUG << url << ":\n" << downloadBuffer;
+	else
+		LOG_ERROR << "LISTING_STATUS failed, HTTP code: " << code;
 }
 
 
@@ -460,17 +777,57 @@ static void downloadGlobalQuote
 {
 	// GLOBAL_QUOTE
 	string url = GlobalQuotePrefix + symbol + GlobalQuoteSuffix;
-	downloadBuffer.clear();
-	cout << url << endl;
+	LOG_DEBUG << url;
 
-	CURLcode res = downloadURL(curl, url);
+	long code = fetch_with_backoff(curl, url, downloadBuffer, AlphaVantageProvider);
 
-	if (res == CURLE_OK)
-		cout << symbol << ": " << endl << downloadBuffer << endl;
+	if (code == 200)
+		LOG_DEBUG << symbol << ":\n" << downloadBuffer;
 	else
-		cerr << symbol << "error" << endl;
+		LOG_ERROR << symbol << " error, HTTP code: " << code;
+}
+
 
-	this_thread::sleep_until(chrono::system_clock::now() + chrono::seconds(4));
+// Alpha Vantage output lives under <path>/AlphaVantage with the same layout and CSV format as the Yahoo Finance tree
+static string alphaVantagePath(const _TICKER_TAPE_ARGS& args)
+{
+	return args.path + PathSeparator + "AlphaVantage";
+}
+
+
+// Writes the rows of <bars> (any order) as one partition per local day. Returns the number of days written.
+static size_t writeDailyPartitions
+(
+	BarVector& bars,
+	const string& basePath,
+	const string& symbol,
+	SaveType saveType,
+	_MULTI_SINK_WRITER& writer
+)
+{
+	std::sort(bars.begin(), bars.end(), [](const _BAR& a, const _BAR& b) { return a.timestamp < b.timestamp; });
+
+	size_t days = 0;
+
+	// every day is the run of rows up to the end of the first row's local day
+	for (auto first = bars.cbegin(); first != bars.cend();)
+	{
+		TimePoint day = system_clock::from_time_t(static_cast<std::time_t>(first->timestamp));
+		auto [period1, period2] = computeLocalDayEpochRange(day);
+
+		auto last = first;
+		while (last != bars.cend() && last->timestamp < period2)
+			++last;
+
+		string csvBuffer;
+		formatBarsCSV(first, last, csvBuffer);
+		writer.write(makeOutputFilenames(basePath, symbol, day, saveType), nullptr, make_shared<const string>(std::move(csvBuffer)));
+		++days;
+
+		first = last;
+	}
+
+	return days;
 }
 
 
@@ -479,40 +836,63 @@ static void downloadTimeSeriesDaily
 	CURL* curl,
 	string& downloadBuffer,
 	const string& symbol,
-	_TICKER_TAPE_ARGS& args
+	_TICKER_TAPE_ARGS& args,
+	_MULTI_SINK_WRITER& writer
 )
 {
 	// TIME_SERIES_DAILY
 	string url = TimeSeriesDailyPrefix + symbol + TimeSeriesDailySuffix;
-	downloadBuffer.clear();
-	cout << url << endl;
+	LOG_DEBUG << url;
 
-	CURLcode res = downloadURL(curl, url);
+	long code = fetch_with_backoff(curl, url, downloadBuffer, AlphaVantageProvider);
 
-	if (res == CURLE_OK)
-		cout << symbol << ": " << endl << downloadBuffer << endl;
-	else
-		cerr << symbol << "error" << endl;
+	if (code != 200)
+	{
+		LOG_ERROR << symbol << " error, HTTP code: " << code;
+		return;
+	}
+
+	LOG_DEBUG << symbol << ":\n" << downloadBuffer;
 
-	const string TimeSeriesDaily("Time Series (Daily)");
-	json j = json::parse(downloadBuffer);
+	BarVector bars;
+	_BAR latest{};
+	string latestDate;
 
-	if (j.contains(TimeSeriesDaily))
+	CsvBarParser parser([&](std::string_view timestamp, const _BAR& bar)
 	{
-		auto& timeSeries = j[TimeSeriesDaily];
-		auto lastEntry = timeSeries.begin();
-		string latestDate = lastEntry.key();
-		auto& dailyData = lastEntry.value();
+		if (bars.empty() || bar.timestamp > latest.timestamp)
+		{
+			latest = bar;
+			latestDate.assign(timestamp);
+		}
+		bars.push_back(bar);
+	}, CsvTimeZone::UsEastern);
 
-		// Output stock data
-		std::cout << "Latest date: " << latestDate << "\n";
-		std::cout << "Open:  " << dailyData["1. open"] << "\n";
-		std::cout << "High:  " << dailyData["2. high"] << "\n";
-		std::cout << "Low:   " << dailyData["3. low"] << "\n";
-		std::cout << "Close: " << dailyData["4. close"] << "\n";
+	if (!parser.feed(downloadBuffer) || !parser.finish())
+	{
+		LOG_ERROR << symbol << " TIME_SERIES_DAILY: " << downloadBuffer;
+		return;
 	}
 
-	this_thread::sleep_until(chrono::system_clock::now() + chrono::seconds(4));
+	if (bars.empty())
+		return;
+
+	LOG_INFO << symbol << " latest date: " << latestDate << "\n"
+		<< "Open:  " << latest.open << "\n"
+		<< "High:  " << latest.high << "\n"
+		<< "Low:   " << latest.low << "\n"
+		<< "Close: " << latest.close;
+
+	// daily bars are one series per symbol rather than a partition per day
+	std::sort(bars.begin(), bars.end(), [](const _BAR& a, const _BAR& b) { return a.timestamp < b.timestamp; });
+
+	string folder = alphaVantagePath(args) + PathSeparator + "Single";
+	std::error_code ec;
+	std::filesystem::create_directories(folder, ec);
+
+	string csvBuffer;
+	formatBarsCSV(bars.cbegin(), bars.cend(), csvBuffer);
+	writer.write({ OutputTarget{ string(), folder + PathSeparator + symbol + "_1d.csv" } }, nullptr, make_shared<const string>(std::move(csvBuffer)));
 }
 
 
@@ -521,24 +901,42 @@ static void downloadTimeSeriesIntraday
 	CURL* curl,
 	string& downloadBuffer,
 	const string& symbol,
-	_TICKER_TAPE_ARGS& args
+	_TICKER_TAPE_ARGS& args,
+	SaveType saveType,
+	_MULTI_SINK_WRITER& writer
 )
 {
 	// TIME_SERIES_INTRADAY
 	string url = TimeSeriesIntradayPrefix + symbol + TimeSeriesIntradaySuffix;
-	downloadBuffer.clear();
-	cout << url << endl;
+	LOG_DEBUG << url;
 
-	CURLcode res = downloadURL(curl, url);
+	long code = fetch_with_backoff(curl, url, downloadBuffer, AlphaVantageProvider);
 
-	if (res == CURLE_OK)
-		cout << symbol << ": " << endl << downloadBuffer << endl;
-	else
-		cerr << symbol << "error" << endl;
+	if (code != 200)
+	{
+		LOG_ERROR << symbol << " error, HTTP code: " << code;
+		return;
+	}
+
+	LOG_DEBUG << symbol << ":\n" << downloadBuffer;
+
+	// Alpha Vantage stamps are US/Eastern, the partitions are UTC like the Yahoo ones
+	BarVector bars;
+	CsvBarParser parser([&bars](std::string_view, const _BAR& bar) { bars.push_back(bar); }, CsvTimeZone::UsEastern);
+
+	if (!parser.feed(downloadBuffer) || !parser.finish())
+	{
+		LOG_ERROR << symbol << " TIME_SERIES_INTRADAY: " << downloadBuffer;
+		return;
+	}
+
+	if (parser.rejected() > 0)
+		LOG_WARNING << symbol << ": " << parser.rejected() << " malformed row(s) skipped";
 
-	cout << endl;
+	SaveType writeTypes = args.bDeriveRollups ? SaveType::DailyFile : saveType;
+	size_t days = writeDailyPartitions(bars, alphaVantagePath(args), symbol, writeTypes, writer);
 
-	this_thread::sleep_until(chrono::system_clock::now() + chrono::seconds(4));
+	LOG_INFO << symbol << ": " << parser.rows() << " Alpha Vantage 1m row(s) in " << days << " day(s)";
 }
 
 
@@ -546,12 +944,13 @@ static void downloadAlphaVantage
 (
 	CURL* curl,
 	string& downloadBuffer,
-	Stock& stocks,
 	map<string, string>& symbols,
 	_TICKER_TAPE_ARGS& args,
 	SaveType saveType
 )
 {
+	_MULTI_SINK_WRITER writer;
+
 	// LISTING_STATUS
 	downloadListingStatus(curl, downloadBuffer, args);
 
@@ -561,11 +960,13 @@ static void downloadAlphaVantage
 		downloadGlobalQuote(curl, downloadBuffer, symbol.first, args);
 
 		// TIME_SERIES_DAILY
-		downloadTimeSeriesDaily(curl, downloadBuffer, symbol.first, args);
+		downloadTimeSeriesDaily(curl, downloadBuffer, symbol.first, args, writer);
 
 		// TIME_SERIES_INTRADAY
-		downloadTimeSeriesIntraday(curl, downloadBuffer, symbol.first, args);
+		downloadTimeSeriesIntraday(curl, downloadBuffer, symbol.first, args, saveType, writer);
 	}
+
+	writer.flush();
 }
 
 
@@ -589,18 +990,42 @@ static bool downloadStocks
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &downloadBuffer);
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 	curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (compatible)");
+	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, AcceptAnyEncoding);
+
+	_CASSETTE_OPTIONS cassetteOptions;
+	cassetteOptions.mode = args.cassetteMode;
+	cassetteOptions.folder = getFullpath(args.path, args.cassetteFolder);
+	cassetteOptions.latency = std::chrono::milliseconds(args.cassetteLatencyMs);
+	cassetteOptions.errorRate = args.cassetteErrorRate;
+	cassetteOptions.errorCode = args.cassetteErrorCode;
+	if (!getCassette().configure(cassetteOptions))
+	{
+		LOG_ERROR << "Cannot replay, no cassette in " << cassetteOptions.folder;
+		return false;
+	}
+
+	// replays measure the pipeline itself, so the providers' limits only apply to live runs
+	RateScheduler& scheduler = getRateScheduler();
+	if (args.cassetteMode != CassetteMode::Replay)
+	{
+		scheduler.configure(YahooProvider, args.yahooRequestsPerSecond, args.yahooBurst);
+		scheduler.configure(AlphaVantageProvider, args.alphaVantageRequestsPerMinute / 60.0, 1.0);
+	}
+
+	// the providers are paced independently, so Alpha Vantage runs alongside Yahoo Finance
+	std::thread alphaVantage([&]()
+	{
+		LOG_INFO << "Downloading Alpha Vantage...";
+		downloadAlphaVantage(curl, downloadBuffer, symbols, args, saveType);
+		LOG_INFO << "Alpha Vantage completed.";
+	});
 
-	 // Yahoo Finance
-	cout << "Downloading Yahoo Finance..." << endl;
-	downloadYahoo(curl, downloadBuffer, stocks, symbols, args, saveType);
-	cout << "Yahoo Finance completed." << endl;
-	std::this_thread::sleep_for(std::chrono::seconds(9));
+	// Yahoo Finance
+	LOG_INFO << "Downloading Yahoo Finance...";
+	downloadYahoo(stocks, symbols, args, saveType);
+	LOG_INFO << "Yahoo Finance completed.";
 
-	// Alpha Vantage
-	cout << "Downloading Alpha Vantage..." << endl;
-	downloadAlphaVantage(curl, downloadBuffer, stocks, symbols, args, saveType);
-	cout << "Alpha Vantage completed." << endl;
-	std::this_thread::sleep_for(std::chrono::seconds(9));
+	alphaVantage.join();
 
 	curl_easy_cleanup(curl);
 	curl_global_cleanup();
@@ -643,23 +1068,31 @@ static bool writeSymbolsDownloadURLs(map<string, string>& symbols, const string&
 }
 
 
+// the URLs of the symbols that have trades in <stocks>; the store is keyed by timestamp, so they are collected first
 static bool writeStocksDownloadURLs(Stock& stocks, const string& filename)
 {
+	set<string> downloaded;
+	for (auto& stock : stocks)
+	{
+		for (auto& trade : stock.second)
+			downloaded.insert(get<0>(trade));
+	}
+
 	ofstream outFile(filename);
 
 	// LISTING_STATUS
 	outFile << ListingStatusPrefix + ListingStatusSuffix << endl;
 
-	for (auto& symbol : stocks)
+	for (auto& symbol : downloaded)
 	{
 		// GLOBAL_QUOTE
-		outFile << GlobalQuotePrefix << symbol.first << GlobalQuoteSuffix << endl;
+		outFile << GlobalQuotePrefix << symbol << GlobalQuoteSuffix << endl;
 
 		// TIME_SERIES_DAILY
-		outFile << TimeSeriesDailyPrefix << symbol.first << TimeSeriesDailySuffix << endl;
+		outFile << TimeSeriesDailyPrefix << symbol << TimeSeriesDailySuffix << endl;
 
 		// TIME_SERIES_INTRADAY
-		outFile << TimeSeriesIntradayPrefix << symbol.first << TimeSeriesIntradaySuffix << endl;
+		outFile << TimeSeriesIntradayPrefix << symbol << TimeSeriesIntradaySuffix << endl;
 	}
 
 	outFile.close();
@@ -670,21 +1103,31 @@ static bool writeStocksDownloadURLs(Stock& stocks, const string& filename)
 
 static void writeCombinedData(Stock& stocks, const string& filename)
 {
-	ofstream outCombinedFile(filename);
+	AsyncFileWriter outCombinedFile(filename);
+	if (!outCombinedFile.is_open())
+	{
+		LOG_ERROR << "Cannot open " << filename;
+		return;
+	}
 
-	// use first map entry vector size as the number of data points to write
-	for (StockItr stockItr = stocks.begin(); stockItr != stocks.end(); ++stockItr)
+	// one trade per line: <timestamp> <symbol> <price> <volume>
+	for (auto& stock : stocks)
 	{
-		for (TradeVectorItr tradeItr = stockItr->second.begin(); tradeItr != stockItr->second.end(); ++tradeItr)
+		for (auto& trade : stock.second)
 		{
-			Trade& trade = *tradeItr;
-			outCombinedFile << stockItr->first << " " << get<0>(trade) << " " << get<1>(trade) << " " << get<2>(trade);
-
-			// write  CR/LF if more data is available (either another timestamp or another trade for the current day
-			if (next(stockItr, 1) != stocks.end() || next(tradeItr, 1) != stockItr->second.end())
-				outCombinedFile << endl;
+			outCombinedFile.write(stock.first);
+			outCombinedFile.write(' ');
+			outCombinedFile.write(get<0>(trade));
+			outCombinedFile.write(' ');
+			outCombinedFile.writeNumber(get<1>(trade));
+			outCombinedFile.write(' ');
+			outCombinedFile.writeNumber(get<2>(trade));
+			outCombinedFile.write('\n');
 		}
 	}
+
+	if (!outCombinedFile.close())
+		LOG_ERROR << "Error writing " << filename;
 }
 
 
@@ -877,7 +1320,7 @@ static bool cleanFiles
 	{
 		in++;
 		--out;
-		cout << "in=" << in << " out=" << out << " filename=" << filename << endl;
+		LOG_DEBUG << "in=" << in << " out=" << out << " filename=" << filename;
 
 		std::error_code ec;
 		if (fs::exists(filename, ec))
@@ -932,7 +1375,7 @@ bool downloadDataset
 
 	if (args.bCleanApp)
 	{
-		cout << "Deleting old files...";
+		LOG_INFO << "Deleting old files...";
 
 		ensureDirectories(saveType, args.path);
 
@@ -949,31 +1392,84 @@ bool downloadDataset
 			in,
 			out
 		);
-		cout << "done." << endl;
+		LOG_INFO << "Deleting old files done.";
 	}
 
-	cout << "Adding symbols from " << fullpathSymbolsFilename << endl;
+	LOG_INFO << "Adding symbols from " << fullpathSymbolsFilename;
 	addSymbols(symbols, fullpathSymbolsFilename);
 
 	downloadStocks(stocks, symbols, args, saveType);
 
-	cout << "Writing Symbols URL's " << fullpathSymbolsURLsFilename  << endl;
+	// out-of-core: the stages stream the partitions instead of the Stock store, see OutOfCore.h. Without a
+	// memory cap the store is filled from the same partitions, so both modes replay and export one dataset
+	const bool bChunked = args.memoryCapMB > 0;
+	const _CHUNK_OPTIONS chunkOptions = makeChunkOptions(args);
+
+	if (!bChunked)
+		loadStockStore(args.path, stocks);
+
+	std::future<bool> compaction;
+	if (args.bDeriveRollups)
+	{
+		LOG_INFO << "Compacting Daily partitions into rollups";
+		if (args.bCompactInBackground)
+			compaction = compactPartitionsAsync(args.path, saveType);
+		else
+			compactPartitions(args.path, saveType);
+	}
+
+	LOG_INFO << "Writing Symbols URL's " << fullpathSymbolsURLsFilename;
 	writeSymbolsDownloadURLs(symbols, fullpathSymbolsURLsFilename);
 
-	cout << "Writing Stocks downloaded URL's " << fullpathStocksURLsFilename << endl;
+	LOG_INFO << "Writing Stocks downloaded URL's " << fullpathStocksURLsFilename;
 	writeStocksDownloadURLs(stocks, fullpathStocksURLsFilename);
 
-	cout << "Writing combined data to " << fullpathCombinedStocksFilename << endl;
-	writeCombinedData(stocks, fullpathCombinedStocksFilename);
+	LOG_INFO << "Writing combined data to " << fullpathCombinedStocksFilename;
+	if (bChunked)
+		exportCombinedChunked(args.path, fullpathCombinedStocksFilename, chunkOptions);
+	else
+		writeCombinedData(stocks, fullpathCombinedStocksFilename);
+
+	if (!bChunked)
+	{
+		// parsed into a map of its own, the store already holds every row of the file
+		LOG_INFO << "Testing parsing algorithm for " << fullpathCombinedStocksFilename;
+		Stock parsed;
+		parseStocks(parsed, fullpathCombinedStocksFilename);
+		if (parsed.size() != stocks.size())
+			LOG_WARNING << "Parsed " << parsed.size() << " timestamp(s) back from " << fullpathCombinedStocksFilename << ", the store has " << stocks.size();
+	}
+
+	if (compaction.valid() && !compaction.get())
+		LOG_ERROR << "Compaction of rollup partitions failed";
 
-	cout << "Testing parsing algorithm for " << fullpathCombinedStocksFilename << endl;
-	parseStocks(stocks, fullpathCombinedStocksFilename);
+	if (!args.resampleMinutes.empty())
+	{
+		LOG_INFO << "Resampling Daily partitions";
+		bool lResampled = bChunked ? resamplePartitionsChunked(args.path, args.resampleMinutes, chunkOptions)
+			: resamplePartitions(args.path, args.resampleMinutes, args.resampleWorkers);
+		if (!lResampled)
+			LOG_ERROR << "Resampling Daily partitions failed";
+	}
+
+	if (args.bMergeSources)
+	{
+		LOG_INFO << "Merging source partitions";
+		if (!mergeSourcePartitions(args, saveType))
+			LOG_ERROR << "Merging source partitions failed";
+	}
+
+	if (bChunked)
+		return true;
 
-	cout << "Parsing combined stocks from " << fullpathParseStocksFilename << endl;
-	if (!parseCSVStocks(stocks, fullpathParseStocksFilename, args.path, date))
+	// kept out of the store as well, which holds the partitions only
+	LOG_INFO << "Parsing combined stocks from " << fullpathParseStocksFilename;
+	Stock parsed;
+	if (!parseCSVStocks(parsed, fullpathParseStocksFilename, args.path, date))
 	{
-		cout << "Error reading " << fullpathParseStocksFilename << endl;
-		cout << "Press any key to continue. . .";
+		LOG_ERROR << "Error reading " << fullpathParseStocksFilename;
+		LOG_INFO << "Press any key to continue. . .";
+		getLogger().flush();
 		cin.get();
 		return false;
 	}
@@ -0,0 +1,561 @@
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#include <io.h>
+#include <fcntl.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <unistd.h>
+#endif
+
+#include "Stream.h"
+#include "Log.h"
+
+using namespace std;
+using namespace std::chrono;
+
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+static const intptr_t NoSocket = static_cast<intptr_t>(INVALID_SOCKET);
+static void closeSocket(intptr_t s) { closesocket(static_cast<SOCKET>(s)); }
+#else
+using SocketHandle = int;
+static const intptr_t NoSocket = -1;
+static void closeSocket(intptr_t s) { ::close(static_cast<int>(s)); }
+#endif
+
+static bool initSockets()
+{
+#ifdef _WIN32
+	static const bool bStarted = []()
+	{
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return bStarted;
+#else
+	return true;
+#endif
+}
+
+
+// console streams carry binary records, so no newline translation
+static void setConsoleBinary()
+{
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+
+bool _STREAM_ENDPOINT::parse(const string& text, _STREAM_ENDPOINT& endpoint)
+{
+	endpoint = _STREAM_ENDPOINT();
+
+	if (text.empty() || text == "-" || text == "stdin" || text == "stdout")
+	{
+		endpoint.kind = Kind::Console;
+		return true;
+	}
+
+	if (text.compare(0, 7, "unix://") == 0)
+	{
+		endpoint.kind = Kind::Unix;
+		endpoint.path = text.substr(7);
+		return !endpoint.path.empty();
+	}
+
+	string hostPort = text.compare(0, 6, "tcp://") == 0 ? text.substr(6) : text;
+	size_t colon = hostPort.rfind(':');
+	if (colon == string::npos || colon + 1 == hostPort.size())
+		return false;
+
+	endpoint.kind = Kind::Tcp;
+	endpoint.host = colon > 0 ? hostPort.substr(0, colon) : "127.0.0.1";
+	endpoint.port = hostPort.substr(colon + 1);
+	return true;
+}
+
+
+string _STREAM_ENDPOINT::describe() const
+{
+	switch (kind)
+	{
+	case Kind::Tcp: return "tcp://" + host + ":" + port;
+	case Kind::Unix: return "unix://" + path;
+	default: return "console";
+	}
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Framing
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+static void putLE(char* p, T value)
+{
+	for (size_t i = 0; i < sizeof(T); ++i)
+		p[i] = static_cast<char>((static_cast<uint64_t>(value) >> (8 * i)) & 0xFF);
+}
+
+
+template <typename T>
+static T getLE(const char* p)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < sizeof(T); ++i)
+		value |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+	return static_cast<T>(value);
+}
+
+
+void encodeTrade(const _TRADE& trade, StreamFraming framing, string& out)
+{
+	if (framing == StreamFraming::Binary)
+	{
+		char record[BinaryTradeSize] = {};
+		memcpy(record, trade.stkSym.data(), std::min<size_t>(trade.stkSym.size(), 8));
+		putLE<uint32_t>(record + 8, static_cast<uint32_t>(trade.numShares));
+
+		uint64_t priceBits;
+		memcpy(&priceBits, &trade.price, sizeof(priceBits));
+		putLE<uint64_t>(record + 16, priceBits);
+		putLE<int64_t>(record + 24, duration_cast<nanoseconds>(trade.transTime.time_since_epoch()).count());
+
+		out.append(record, sizeof(record));
+		return;
+	}
+
+	char line[96];
+	long long epochMs = duration_cast<milliseconds>(trade.transTime.time_since_epoch()).count();
+	int n = snprintf(line, sizeof(line), "%s,%d,%.4f,%lld\n", trade.stkSym.c_str(), trade.numShares, trade.price, epochMs);
+	if (n > 0)
+		out.append(line, std::min(static_cast<size_t>(n), sizeof(line) - 1));
+}
+
+
+bool TradeDecoder::decodeLine(string_view line, _TRADE& trade)
+{
+	if (!line.empty() && line.back() == '\r')
+		line.remove_suffix(1);
+
+	string_view fields[4];
+	for (size_t i = 0; i < 4; ++i)
+	{
+		size_t comma = line.find(',');
+		if (comma == string_view::npos && i < 3)
+			return false;
+
+		fields[i] = line.substr(0, comma);
+		line.remove_prefix(comma == string_view::npos ? line.size() : comma + 1);
+	}
+
+	long long epochMs = 0;
+	auto parse = [](string_view text, auto& value)
+	{
+		auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+		return ec == std::errc() && ptr == text.data() + text.size();
+	};
+
+	if (fields[0].empty() || !parse(fields[1], trade.numShares) || !parse(fields[2], trade.price) || !parse(fields[3], epochMs))
+		return false;
+
+	trade.stkSym.assign(fields[0]);
+	trade.transTime = TimePoint(duration_cast<TimePoint::duration>(milliseconds(epochMs)));
+	return true;
+}
+
+
+void TradeDecoder::decodeRecord(const char* record, _TRADE& trade)
+{
+	trade.stkSym.assign(record, strnlen(record, 8));
+	trade.numShares = static_cast<int>(getLE<uint32_t>(record + 8));
+
+	uint64_t priceBits = getLE<uint64_t>(record + 16);
+	memcpy(&trade.price, &priceBits, sizeof(priceBits));
+
+	trade.transTime = TimePoint(duration_cast<TimePoint::duration>(nanoseconds(getLE<int64_t>(record + 24))));
+}
+
+
+size_t TradeDecoder::decode(string_view chunk, TradeStructVector& trades)
+{
+	const size_t before = trades.size();
+	_TRADE trade;
+
+	if (framing == StreamFraming::Binary)
+	{
+		// complete the record split across the previous chunk
+		if (!partial.empty())
+		{
+			size_t need = std::min(BinaryTradeSize - partial.size(), chunk.size());
+			partial.append(chunk.substr(0, need));
+			chunk.remove_prefix(need);
+
+			if (partial.size() < BinaryTradeSize)
+				return 0;
+
+			decodeRecord(partial.data(), trade);
+			trades.push_back(std::move(trade));
+			partial.clear();
+		}
+
+		for (; chunk.size() >= BinaryTradeSize; chunk.remove_prefix(BinaryTradeSize))
+		{
+			decodeRecord(chunk.data(), trade);
+			trades.push_back(std::move(trade));
+		}
+
+		partial.assign(chunk);
+		return trades.size() - before;
+	}
+
+	auto accept = [&](string_view line)
+	{
+		if (line.empty() || line == "\r")
+			return;
+
+		if (decodeLine(line, trade))
+			trades.push_back(std::move(trade));
+		else
+			++rejectedCount;
+	};
+
+	if (!partial.empty())
+	{
+		size_t newline = chunk.find('\n');
+		if (newline == string_view::npos)
+		{
+			partial.append(chunk);
+			return 0;
+		}
+
+		partial.append(chunk.substr(0, newline));
+		accept(partial);
+		partial.clear();
+		chunk.remove_prefix(newline + 1);
+	}
+
+	for (size_t newline; (newline = chunk.find('\n')) != string_view::npos; chunk.remove_prefix(newline + 1))
+		accept(chunk.substr(0, newline));
+
+	partial.assign(chunk);
+	return trades.size() - before;
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Connections
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+// opens a socket for <endpoint> and either connects it or binds and listens on it
+static intptr_t openSocket(const _STREAM_ENDPOINT& endpoint, bool bListen)
+{
+	if (!initSockets())
+		return NoSocket;
+
+	if (endpoint.kind == _STREAM_ENDPOINT::Kind::Unix)
+	{
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if (endpoint.path.size() >= sizeof(address.sun_path))
+			return NoSocket;
+		memcpy(address.sun_path, endpoint.path.c_str(), endpoint.path.size() + 1);
+
+		SocketHandle s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (static_cast<intptr_t>(s) == NoSocket)
+			return NoSocket;
+
+		bool lOK;
+		if (bListen)
+		{
+			// a stale socket file from an earlier run would make bind() fail
+			std::remove(endpoint.path.c_str());
+			lOK = ::bind(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 && ::listen(s, 4) == 0;
+		}
+		else
+		{
+			lOK = ::connect(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+		}
+
+		if (!lOK)
+		{
+			closeSocket(static_cast<intptr_t>(s));
+			return NoSocket;
+		}
+
+		return static_cast<intptr_t>(s);
+	}
+
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = bListen ? AI_PASSIVE : 0;
+
+	addrinfo* results = nullptr;
+	if (getaddrinfo(endpoint.host.c_str(), endpoint.port.c_str(), &hints, &results) != 0)
+		return NoSocket;
+
+	intptr_t found = NoSocket;
+	for (addrinfo* ai = results; ai && found == NoSocket; ai = ai->ai_next)
+	{
+		SocketHandle s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (static_cast<intptr_t>(s) == NoSocket)
+			continue;
+
+		bool lOK;
+		if (bListen)
+		{
+			int reuse = 1;
+			setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+			lOK = ::bind(s, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) == 0 && ::listen(s, 4) == 0;
+		}
+		else
+		{
+			lOK = ::connect(s, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) == 0;
+		}
+
+		if (lOK)
+			found = static_cast<intptr_t>(s);
+		else
+			closeSocket(static_cast<intptr_t>(s));
+	}
+
+	freeaddrinfo(results);
+	return found;
+}
+
+
+StreamConnection::~StreamConnection()
+{
+	if (!bConsole && handle != NoSocket)
+		closeSocket(handle);
+}
+
+
+unique_ptr<StreamConnection> StreamConnection::connect(const _STREAM_ENDPOINT& endpoint)
+{
+	if (endpoint.kind == _STREAM_ENDPOINT::Kind::Console)
+	{
+		setConsoleBinary();
+		return unique_ptr<StreamConnection>(new StreamConnection(NoSocket, true));
+	}
+
+	intptr_t s = openSocket(endpoint, false);
+	if (s == NoSocket)
+		return nullptr;
+
+	return unique_ptr<StreamConnection>(new StreamConnection(s, false));
+}
+
+
+long long StreamConnection::read(char* buffer, size_t size)
+{
+	if (bConsole)
+	{
+		// read() returns whatever is available, fread() would wait for a full buffer
+#ifdef _WIN32
+		return _read(0, buffer, static_cast<unsigned>(std::min<size_t>(size, 1 << 30)));
+#else
+		return ::read(0, buffer, size);
+#endif
+	}
+
+	long long n = ::recv(static_cast<SocketHandle>(handle), buffer, static_cast<int>(std::min<size_t>(size, 1 << 30)), 0);
+	return n < 0 ? -1 : n;
+}
+
+
+bool StreamConnection::writeAll(string_view data)
+{
+	if (bConsole)
+	{
+		bool lOK = fwrite(data.data(), 1, data.size(), stdout) == data.size();
+		return lOK && fflush(stdout) == 0;
+	}
+
+	while (!data.empty())
+	{
+		int flags = 0;
+#ifdef MSG_NOSIGNAL
+		flags = MSG_NOSIGNAL;
+#endif
+		long long n = ::send(static_cast<SocketHandle>(handle), data.data(), static_cast<int>(std::min<size_t>(data.size(), 1 << 30)), flags);
+		if (n <= 0)
+			return false;
+
+		data.remove_prefix(static_cast<size_t>(n));
+	}
+
+	return true;
+}
+
+
+void StreamConnection::shutdown()
+{
+	if (bConsole || handle == NoSocket)
+		return;
+
+#ifdef _WIN32
+	::shutdown(static_cast<SocketHandle>(handle), SD_BOTH);
+#else
+	::shutdown(static_cast<SocketHandle>(handle), SHUT_RDWR);
+#endif
+}
+
+
+StreamListener::~StreamListener()
+{
+	if (handle != NoSocket)
+		closeSocket(handle);
+
+	if (endpoint.kind == _STREAM_ENDPOINT::Kind::Unix)
+		std::remove(endpoint.path.c_str());
+}
+
+
+unique_ptr<StreamListener> StreamListener::listen(const _STREAM_ENDPOINT& endpoint)
+{
+	if (endpoint.kind == _STREAM_ENDPOINT::Kind::Console)
+		return unique_ptr<StreamListener>(new StreamListener(NoSocket, endpoint));
+
+	intptr_t s = openSocket(endpoint, true);
+	if (s == NoSocket)
+		return nullptr;
+
+	return unique_ptr<StreamListener>(new StreamListener(s, endpoint));
+}
+
+
+unique_ptr<StreamConnection> StreamListener::accept()
+{
+	if (endpoint.kind == _STREAM_ENDPOINT::Kind::Console)
+	{
+		if (bConsoleTaken)
+			return nullptr;
+
+		bConsoleTaken = true;
+		setConsoleBinary();
+		return unique_ptr<StreamConnection>(new StreamConnection(NoSocket, true));
+	}
+
+	SocketHandle s = ::accept(static_cast<SocketHandle>(handle), nullptr, nullptr);
+	if (static_cast<intptr_t>(s) == NoSocket)
+		return nullptr;
+
+	return unique_ptr<StreamConnection>(new StreamConnection(static_cast<intptr_t>(s), false));
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Live ingest
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+TradeStream::TradeStream(StreamFraming framing, size_t maxBatch, milliseconds maxDelay, size_t queueCapacity)
+	: decoder(framing), maxBatch(std::max<size_t>(maxBatch, 1)), maxDelay(maxDelay), chunks(make_shared<BoundedQueue<string>>(queueCapacity))
+{
+}
+
+
+TradeStream::~TradeStream()
+{
+	if (connection)
+		connection->shutdown();
+	chunks->close();
+
+	// a console read cannot be interrupted, the process exit ends it; the thread keeps the connection and
+	// the queue alive through its own references
+	if (reader.joinable())
+	{
+		if (connection && connection->isConsole())
+			reader.detach();
+		else
+			reader.join();
+	}
+}
+
+
+bool TradeStream::open(const _STREAM_ENDPOINT& endpoint)
+{
+	connection = StreamConnection::connect(endpoint);
+	if (!connection)
+	{
+		LOG_ERROR << "Cannot connect to " << endpoint.describe();
+		return false;
+	}
+
+	LOG_INFO << "Streaming trades from " << endpoint.describe();
+	reader = thread(&TradeStream::readerLoop, connection, chunks);
+	return true;
+}
+
+
+void TradeStream::readerLoop(shared_ptr<StreamConnection> connection, shared_ptr<BoundedQueue<string>> chunks)
+{
+	const size_t ChunkSize = 64 * 1024;
+
+	for (;;)
+	{
+		string chunk(ChunkSize, '\0');
+		long long n = connection->read(chunk.data(), chunk.size());
+		if (n <= 0)
+			break;
+
+		chunk.resize(static_cast<size_t>(n));
+		if (!chunks->push(std::move(chunk)))
+			break;
+	}
+
+	chunks->close();
+}
+
+
+bool TradeStream::next(TradeStructVector& batch)
+{
+	batch.clear();
+
+	// trades left over from a chunk that overflowed the previous batch come first
+	auto take = [&]()
+	{
+		size_t n = std::min(maxBatch - batch.size(), pending.size());
+		std::move(pending.begin(), pending.begin() + n, std::back_inserter(batch));
+		pending.erase(pending.begin(), pending.begin() + n);
+	};
+
+	take();
+
+	auto deadline = PipelineClock::now() + maxDelay;
+	string chunk;
+
+	while (batch.size() < maxBatch && !bEnded)
+	{
+		if (!chunks->popUntil(chunk, deadline, bEnded))
+		{
+			// an idle stream keeps waiting for its first trade, but only up to one delay per call
+			break;
+		}
+
+		bool bFirst = batch.empty() && pending.empty();
+		decoder.decode(chunk, pending);
+		take();
+
+		if (bFirst && !batch.empty())
+			deadline = PipelineClock::now() + maxDelay;
+	}
+
+	tradeCount += batch.size();
+	batchCount += batch.empty() ? 0 : 1;
+
+	return !(bEnded && batch.empty() && pending.empty());
+}
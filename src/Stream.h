@@ -0,0 +1,152 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "Stock.h"
+#include "Pipeline.h"
+
+// Wire formats of a trade stream (StreamFraming):
+//   Line:   SYMBOL,shares,price,epoch_ms\n
+//   Binary: fixed 32 byte little endian records { char symbol[8]; uint32 shares; uint32 reserved; double price; int64 epoch_ns }
+constexpr size_t BinaryTradeSize = 32;
+
+// Where a stream comes from or goes to: tcp://host:port, unix:///path/to/socket, or - for stdin/stdout
+struct _STREAM_ENDPOINT
+{
+	enum class Kind { Tcp, Unix, Console };
+
+	Kind kind = Kind::Console;
+	std::string host;
+	std::string port;
+	std::string path;
+
+	static bool parse(const std::string& text, _STREAM_ENDPOINT& endpoint);
+	std::string describe() const;
+};
+
+// appends one framed trade to <out>
+void encodeTrade(const _TRADE& trade, StreamFraming framing, std::string& out);
+
+// Turns received bytes into trades, keeping a partial line or record between chunks.
+class TradeDecoder
+{
+public:
+	explicit TradeDecoder(StreamFraming framing) : framing(framing) {}
+
+	// appends the complete trades in <chunk> to <trades> and returns how many were added
+	size_t decode(std::string_view chunk, TradeStructVector& trades);
+
+	size_t rejected() const { return rejectedCount; }
+
+private:
+	bool decodeLine(std::string_view line, _TRADE& trade);
+	void decodeRecord(const char* record, _TRADE& trade);
+
+	StreamFraming framing;
+	std::string partial;
+	size_t rejectedCount = 0;
+};
+
+// A connected byte stream: a TCP or Unix domain socket, or the console.
+class StreamConnection
+{
+public:
+	~StreamConnection();
+
+	StreamConnection(const StreamConnection&) = delete;
+	StreamConnection& operator=(const StreamConnection&) = delete;
+
+	static std::unique_ptr<StreamConnection> connect(const _STREAM_ENDPOINT& endpoint);
+
+	// blocking; returns 0 at the end of the stream and -1 on errors
+	long long read(char* buffer, size_t size);
+	bool writeAll(std::string_view data);
+
+	// unblocks a pending read, sockets only
+	void shutdown();
+
+	bool isConsole() const { return bConsole; }
+
+private:
+	friend class StreamListener;
+	StreamConnection(intptr_t handle, bool bConsole) : handle(handle), bConsole(bConsole) {}
+
+	intptr_t handle;
+	bool bConsole;
+};
+
+// A listening TCP or Unix domain socket; the console "listens" by handing out stdout once.
+class StreamListener
+{
+public:
+	~StreamListener();
+
+	StreamListener(const StreamListener&) = delete;
+	StreamListener& operator=(const StreamListener&) = delete;
+
+	static std::unique_ptr<StreamListener> listen(const _STREAM_ENDPOINT& endpoint);
+	std::unique_ptr<StreamConnection> accept();
+
+private:
+	StreamListener(intptr_t handle, const _STREAM_ENDPOINT& endpoint) : handle(handle), endpoint(endpoint) {}
+
+	intptr_t handle;
+	_STREAM_ENDPOINT endpoint;
+	bool bConsoleTaken = false;
+};
+
+// Live ingest. A reader thread receives raw chunks into a bounded queue; next() decodes them on the
+// caller's thread and returns micro-batches of up to maxBatch trades, or whatever arrived within maxDelay
+// of the batch's first trade, so a quiet stream still reaches the engine promptly.
+class TradeStream
+{
+public:
+	TradeStream(StreamFraming framing, size_t maxBatch, std::chrono::milliseconds maxDelay, size_t queueCapacity = 64);
+	~TradeStream();
+
+	bool open(const _STREAM_ENDPOINT& endpoint);
+
+	// false at the end of the stream; an idle stream returns an empty batch every maxDelay
+	bool next(TradeStructVector& batch);
+
+	size_t trades() const { return tradeCount; }
+	size_t batches() const { return batchCount; }
+	size_t rejected() const { return decoder.rejected(); }
+
+private:
+	static void readerLoop(std::shared_ptr<StreamConnection> connection, std::shared_ptr<BoundedQueue<std::string>> chunks);
+
+	TradeDecoder decoder;
+	size_t maxBatch;
+	std::chrono::milliseconds maxDelay;
+
+	// shared with the reader thread, which outlives the stream when a console read cannot be interrupted
+	std::shared_ptr<StreamConnection> connection;
+	std::shared_ptr<BoundedQueue<std::string>> chunks;
+	TradeStructVector pending;
+	bool bEnded = false;
+	std::thread reader;
+
+	size_t tradeCount = 0;
+	size_t batchCount = 0;
+};
+
+// Stand-in publisher for offline load tests: random trades over <symbols> at a fixed rate, volumes
+// skewed so a few symbols dominate the top-N.
+struct _PUBLISHER_OPTIONS
+{
+	_STREAM_ENDPOINT endpoint;
+	StreamFraming framing = StreamFraming::Line;
+	double tradesPerSecond = 10000.0;		// <= 0 publishes as fast as the subscriber reads
+	size_t count = 0;						// trades to publish before closing, 0 = until the subscriber leaves
+	std::vector<std::string> symbols;
+	unsigned seed = 42;
+};
+
+bool runPublisher(const _PUBLISHER_OPTIONS& options);
@@ -0,0 +1,219 @@
+#include <chrono>
+
+#include "ThreadPool.h"
+#include "Log.h"
+
+using namespace std;
+
+// the pool and deque the current thread works for, if any
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local size_t currentWorker = AnyWorker;
+
+static void execute(PoolTask& task)
+{
+	try
+	{
+		task();
+	}
+	catch (const exception& e)
+	{
+		LOG_ERROR << "Pool task failed: " << e.what();
+	}
+	catch (...)
+	{
+		LOG_ERROR << "Pool task failed";
+	}
+}
+
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, thread::hardware_concurrency());
+
+	for (size_t i = 0; i < threadCount; ++i)
+		queues.push_back(make_unique<_WORKER_QUEUE>());
+
+	for (size_t i = 0; i < threadCount; ++i)
+		threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> guard(idleLock);
+		bStopping = true;
+	}
+	idle.notify_all();
+
+	for (auto& t : threads)
+		t.join();
+}
+
+
+void ThreadPool::submit(PoolTask task, size_t affinity)
+{
+	size_t index;
+	if (affinity != AnyWorker)
+		index = affinity % queues.size();
+	else if (currentPool == this)
+		index = currentWorker;
+	else
+		index = nextQueue.fetch_add(1, memory_order_relaxed) % queues.size();
+
+	{
+		lock_guard<mutex> guard(queues[index]->lock);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+
+	// a worker checks <queued> under idleLock before it sleeps, so this wakeup cannot be lost
+	queued.fetch_add(1, memory_order_release);
+	{
+		lock_guard<mutex> guard(idleLock);
+	}
+	idle.notify_one();
+}
+
+
+bool ThreadPool::popLocal(size_t index, PoolTask& task)
+{
+	_WORKER_QUEUE& queue = *queues[index];
+	lock_guard<mutex> guard(queue.lock);
+	if (queue.tasks.empty())
+		return false;
+
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	queued.fetch_sub(1, memory_order_relaxed);
+	return true;
+}
+
+
+bool ThreadPool::steal(size_t thief, PoolTask& task)
+{
+	const size_t count = queues.size();
+	for (size_t k = 1; k <= count; ++k)
+	{
+		const size_t victim = (thief + k) % count;
+		_WORKER_QUEUE& queue = *queues[victim];
+
+		lock_guard<mutex> guard(queue.lock);
+		if (queue.tasks.empty())
+			continue;
+
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+		queued.fetch_sub(1, memory_order_relaxed);
+		if (victim != thief)
+			stolenCount.fetch_add(1, memory_order_relaxed);
+		return true;
+	}
+
+	return false;
+}
+
+
+bool ThreadPool::runOne()
+{
+	const bool bWorker = currentPool == this;
+	const size_t index = bWorker ? currentWorker : nextQueue.load(memory_order_relaxed) % queues.size();
+
+	PoolTask task;
+	if (!(bWorker && popLocal(index, task)) && !steal(index, task))
+		return false;
+
+	execute(task);
+	executedCount.fetch_add(1, memory_order_relaxed);
+	return true;
+}
+
+
+void ThreadPool::workerLoop(size_t index)
+{
+	currentPool = this;
+	currentWorker = index;
+
+	for (;;)
+	{
+		PoolTask task;
+		if (popLocal(index, task) || steal(index, task))
+		{
+			execute(task);
+			executedCount.fetch_add(1, memory_order_relaxed);
+			continue;
+		}
+
+		unique_lock<mutex> guard(idleLock);
+		idle.wait(guard, [this] { return bStopping || queued.load(memory_order_acquire) > 0; });
+		if (bStopping && queued.load(memory_order_acquire) == 0)
+			return;
+	}
+}
+
+
+TaskGroup::TaskGroup(ThreadPool& pool) : pool(pool)
+{
+}
+
+
+TaskGroup::TaskGroup() : pool(getThreadPool())
+{
+}
+
+
+void TaskGroup::run(PoolTask task, size_t affinity)
+{
+	{
+		lock_guard<mutex> guard(lock);
+		++pending;
+	}
+
+	pool.submit([this, task = std::move(task)]() mutable
+	{
+		execute(task);
+
+		lock_guard<mutex> guard(lock);
+		if (--pending == 0)
+			done.notify_all();
+	}, affinity);
+}
+
+
+void TaskGroup::wait()
+{
+	for (;;)
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			if (pending == 0)
+				return;
+		}
+
+		if (pool.runOne())
+			continue;
+
+		// the group's last tasks run elsewhere; check back now and then for new work to help with
+		unique_lock<mutex> guard(lock);
+		done.wait_for(guard, chrono::milliseconds(1), [this] { return pending == 0; });
+	}
+}
+
+
+ThreadPool& getThreadPool()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+
+void runWorkers(size_t workers, const PoolTask& worker)
+{
+	ThreadPool& pool = getThreadPool();
+	const size_t count = workers == 0 ? pool.size() : std::min(workers, pool.size());
+
+	TaskGroup group(pool);
+	for (size_t t = 0; t < count; ++t)
+		group.run(worker);
+	group.wait();
+}
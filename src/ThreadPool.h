@@ -0,0 +1,100 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Work-stealing pool shared by the loaders, converters and exporters, one thread per core.
+//
+// Every worker owns a deque. A worker pushes the tasks it spawns to the back of its own deque and takes
+// its next task from the back too, so related work stays on the core whose cache it warmed; an idle
+// worker steals from the front of the others' deques, the oldest and usually largest tasks. Tasks from
+// outside the pool are dealt round robin, or to the deque an affinity hint names, which is how callers
+// keep, say, all the files of one symbol on one worker unless others run out of work.
+//
+// TaskGroup waits for the tasks it started. A waiting thread runs queued tasks in the meantime, so a
+// task may start and wait for a group of its own without tying up a worker.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+using PoolTask = std::function<void()>;
+
+constexpr size_t AnyWorker = static_cast<size_t>(-1);
+
+class ThreadPool
+{
+public:
+	explicit ThreadPool(size_t threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t size() const { return queues.size(); }
+
+	// queues <task> on deque <affinity> % size(); without a hint on the caller's own deque when it is one of
+	// the workers, otherwise round robin
+	void submit(PoolTask task, size_t affinity = AnyWorker);
+
+	// runs one queued task on the calling thread, false when there was none
+	bool runOne();
+
+	size_t executed() const { return executedCount.load(std::memory_order_relaxed); }
+	size_t stolen() const { return stolenCount.load(std::memory_order_relaxed); }
+
+private:
+	struct _WORKER_QUEUE
+	{
+		std::mutex lock;
+		std::deque<PoolTask> tasks;
+	};
+
+	bool popLocal(size_t index, PoolTask& task);
+	bool steal(size_t thief, PoolTask& task);
+	void workerLoop(size_t index);
+
+	std::vector<std::unique_ptr<_WORKER_QUEUE>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex idleLock;
+	std::condition_variable idle;
+	std::atomic<size_t> queued{ 0 };
+	std::atomic<size_t> nextQueue{ 0 };
+	bool bStopping = false;
+
+	std::atomic<size_t> executedCount{ 0 };
+	std::atomic<size_t> stolenCount{ 0 };
+};
+
+class TaskGroup
+{
+public:
+	explicit TaskGroup(ThreadPool& pool);
+	TaskGroup();
+	~TaskGroup() { wait(); }
+
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+
+	void run(PoolTask task, size_t affinity = AnyWorker);
+
+	// returns once every task of the group finished, running queued tasks meanwhile
+	void wait();
+
+private:
+	ThreadPool& pool;
+	std::mutex lock;
+	size_t pending = 0;						// under <lock>, so the group outlives the last task's notify
+	std::condition_variable done;
+};
+
+// the process wide pool
+ThreadPool& getThreadPool();
+
+// runs <worker> as min(<workers>, pool size) tasks, 0 = pool size, and waits; the copies share their work
+// themselves, typically through an atomic index
+void runWorkers(size_t workers, const PoolTask& worker);
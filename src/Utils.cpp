@@ -8,6 +8,7 @@
 #pragma comment(lib, "shell32.lib")
 
 #include "Stock.h"
+#include "Log.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -38,11 +39,11 @@ string getDownloadFolder()
 		int size_needed = WideCharToMultiByte(CP_UTF8, 0, wpath.c_str(), -1, NULL, 0, NULL, NULL);
 		string utf8path(size_needed - 1, 0);
 		WideCharToMultiByte(CP_UTF8, 0, wpath.c_str(), -1, utf8path.data(), size_needed, NULL, NULL);
-		cout << "Download folder: " << utf8path << endl;
+		LOG_INFO << "Download folder: " << utf8path;
 		return utf8path;
 	}
 	else {
-		cerr << "Failed to get Downloads folder path. HRESULT: " << hr << endl;
+		LOG_ERROR << "Failed to get Downloads folder path. HRESULT: " << hr;
 	}
 
 	return string();
@@ -91,6 +92,40 @@ string epoch_to_utc_string(long epoch)
 }
 
 
+// days since 1970-01-01 of a proleptic Gregorian date
+long long daysFromCivil(int year, int month, int day)
+{
+	year -= month <= 2;
+	const long long era = (year >= 0 ? year : year - 399) / 400;
+	const unsigned yoe = static_cast<unsigned>(year - era * 400);
+	const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + static_cast<long long>(doe) - 719468;
+}
+
+
+// "yyyy-mm-dd", "yyyy-mm-dd hh:mm" or "yyyy-mm-dd hh:mm:ss" ('T' also separates date and time) in UTC
+bool utc_string_to_epoch(const string& text, long long& epoch)
+{
+	int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+
+	if (sscanf_s(text.c_str(), "%4d-%2d-%2d", &year, &month, &day) != 3)
+		return false;
+
+	if (text.size() > 10)
+	{
+		if ((text[10] != ' ' && text[10] != 'T') || sscanf_s(text.c_str() + 11, "%2d:%2d:%2d", &hour, &minute, &second) < 2)
+			return false;
+	}
+
+	if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+		return false;
+
+	epoch = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+	return true;
+}
+
+
 bool timePointToLocalTm(const TimePoint& tp, std::tm& outLocalTm)
 {
 	std::time_t tt = system_clock::to_time_t(tp);
@@ -0,0 +1,431 @@
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+
+#include "VolumeIndex.h"
+#include "CsvBars.h"
+#include "Log.h"
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+constexpr long long SecondsPerDay = 86400;
+
+// "TTVOLIX" and a format version, followed by segments of
+//   uint32 symbol length, symbol, char date[10], uint64 rows, int64 timestamp[rows], int64 volume[rows]
+static const char VolumeIndexMagic[8] = { 'T', 'T', 'V', 'O', 'L', 'I', 'X', '1' };
+constexpr uint64_t MaxSegmentRows = uint64_t(1) << 24;
+
+// rows of one Daily partition
+struct _VOLUME_SEGMENT
+{
+	vector<long long> timestamp;
+	vector<long long> volume;
+};
+
+// (symbol, yyyy-mm-dd) ordered, so the segments of a symbol are consecutive and in time order
+using VolumeSegmentMap = map<pair<string, string>, _VOLUME_SEGMENT>;
+
+static long long dayOf(long long epoch)
+{
+	return epoch >= 0 ? epoch / SecondsPerDay : (epoch - SecondsPerDay + 1) / SecondsPerDay;
+}
+
+
+void _VOLUME_SERIES::build(const _BAR_SERIES& bars)
+{
+	build(bars.timestamp, bars.volume);
+}
+
+
+void _VOLUME_SERIES::build(const vector<long long>& times, const vector<long long>& volumes)
+{
+	const size_t rows = times.size();
+
+	timestamp = times;
+	cumulative.assign(rows + 1, 0);
+	for (size_t i = 0; i < rows; ++i)
+		cumulative[i + 1] = cumulative[i] + volumes[i];
+
+	dayStart.clear();
+	if (rows == 0)
+		return;
+
+	firstDay = dayOf(timestamp.front());
+	const long long days = dayOf(timestamp.back()) - firstDay + 1;
+	dayStart.resize(static_cast<size_t>(days) + 1);
+
+	// one pass: every day up to and including a row's day starts at or before that row
+	size_t row = 0;
+	for (long long d = 0; d <= days; ++d)
+	{
+		while (row < rows && dayOf(timestamp[row]) - firstDay < d)
+			++row;
+		dayStart[static_cast<size_t>(d)] = static_cast<uint32_t>(row);
+	}
+}
+
+
+size_t _VOLUME_SERIES::rowAt(long long epoch) const
+{
+	if (timestamp.empty())
+		return 0;
+
+	const long long d = dayOf(epoch) - firstDay;
+	if (d < 0)
+		return 0;
+	if (d >= static_cast<long long>(dayStart.size()) - 1)
+		return timestamp.size();
+
+	auto first = timestamp.begin() + dayStart[static_cast<size_t>(d)];
+	auto last = timestamp.begin() + dayStart[static_cast<size_t>(d) + 1];
+	return std::lower_bound(first, last, epoch) - timestamp.begin();
+}
+
+
+long long _VOLUME_SERIES::volume(long long from, long long to) const
+{
+	if (to <= from)
+		return 0;
+
+	return cumulative[rowAt(to)] - cumulative[rowAt(from)];
+}
+
+
+void VolumeIndex::build(const BarStore& store)
+{
+	auto guard = store.lockShared();
+
+	names.clear();
+	series.clear();
+	index.clear();
+	loadedPath.clear();
+
+	for (const auto& entry : store.series())
+		add(entry.first, entry.second);
+
+	storeVersion = store.version();
+}
+
+
+void VolumeIndex::add(const string& symbol, const _BAR_SERIES& bars)
+{
+	add(symbol, bars.timestamp, bars.volume);
+}
+
+
+void VolumeIndex::add(const string& symbol, const vector<long long>& timestamp, const vector<long long>& volume)
+{
+	// no longer what the file holds, the next refresh() loads it again
+	loadedPath.clear();
+
+	auto itr = index.find(symbol);
+	if (itr == index.end())
+	{
+		itr = index.emplace(symbol, names.size()).first;
+		names.push_back(symbol);
+		series.emplace_back();
+	}
+
+	series[itr->second].build(timestamp, volume);
+}
+
+
+long long VolumeIndex::volume(const string& symbol, long long from, long long to) const
+{
+	auto itr = index.find(symbol);
+	return itr == index.end() ? 0 : series[itr->second].volume(from, to);
+}
+
+
+SymbolVolumeVector VolumeIndex::top(long long from, long long to, size_t n) const
+{
+	vector<pair<long long, size_t>> volumes;
+	volumes.reserve(series.size());
+
+	for (size_t i = 0; i < series.size(); ++i)
+	{
+		long long v = series[i].volume(from, to);
+		if (v > 0)
+			volumes.emplace_back(v, i);
+	}
+
+	// largest first, ties by name so the result does not depend on load order
+	auto larger = [this](const pair<long long, size_t>& a, const pair<long long, size_t>& b)
+	{
+		return a.first != b.first ? a.first > b.first : names[a.second] < names[b.second];
+	};
+
+	n = std::min(n, volumes.size());
+	if (n < volumes.size())
+		std::nth_element(volumes.begin(), volumes.begin() + n, volumes.end(), larger);
+	std::sort(volumes.begin(), volumes.begin() + n, larger);
+
+	SymbolVolumeVector result;
+	result.reserve(n);
+	for (size_t i = 0; i < n; ++i)
+		result.emplace_back(names[volumes[i].second], volumes[i].first);
+
+	return result;
+}
+
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Daily/volume.index
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+static fs::path volumeIndexFilename(const string& basePath)
+{
+	return fs::path(basePath) / "Daily" / "volume.index";
+}
+
+
+// with <bKeysOnly> the rows are skipped and every segment is left empty, enough to tell which symbol-days are indexed
+static bool readSegments(const fs::path& filename, VolumeSegmentMap& segments, bool bKeysOnly = false)
+{
+	std::error_code ec;
+	const uintmax_t fileSize = fs::file_size(filename, ec);
+	ifstream in(filename, ios::binary);
+	char magic[sizeof(VolumeIndexMagic)];
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, VolumeIndexMagic, sizeof(magic)) != 0)
+		return false;
+
+	for (;;)
+	{
+		uint32_t symbolLength = 0;
+		if (!in.read(reinterpret_cast<char*>(&symbolLength), sizeof(symbolLength)))
+			return in.gcount() == 0;
+
+		char date[10];
+		uint64_t rows = 0;
+		string symbol(symbolLength, '\0');
+		if (symbolLength == 0 || symbolLength > 256
+			|| !in.read(symbol.data(), symbolLength) || !in.read(date, sizeof(date)) || !in.read(reinterpret_cast<char*>(&rows), sizeof(rows))
+			|| rows > MaxSegmentRows)
+			return false;
+
+		_VOLUME_SEGMENT& segment = segments[make_pair(symbol, string(date, sizeof(date)))];
+		const streamsize bytes = static_cast<streamsize>(rows * sizeof(long long));
+		if (bKeysOnly)
+		{
+			// a seek past the end succeeds, a truncated file shows in the position
+			if (!in.seekg(2 * bytes, ios::cur) || static_cast<uintmax_t>(in.tellg()) > fileSize)
+				return false;
+			continue;
+		}
+
+		segment.timestamp.resize(static_cast<size_t>(rows));
+		segment.volume.resize(static_cast<size_t>(rows));
+		if (!in.read(reinterpret_cast<char*>(segment.timestamp.data()), bytes) || !in.read(reinterpret_cast<char*>(segment.volume.data()), bytes))
+			return false;
+	}
+}
+
+
+static bool writeSegments(const fs::path& filename, const VolumeSegmentMap& segments)
+{
+	// written aside and renamed, so a query never reads a half written index
+	const fs::path tmpFilename = fs::path(filename).concat(".tmp");
+	ofstream out(tmpFilename, ios::binary | ios::trunc);
+	out.write(VolumeIndexMagic, sizeof(VolumeIndexMagic));
+
+	for (const auto& entry : segments)
+	{
+		const string& symbol = entry.first.first;
+		const uint32_t symbolLength = static_cast<uint32_t>(symbol.size());
+		const uint64_t rows = entry.second.timestamp.size();
+		const streamsize bytes = static_cast<streamsize>(rows * sizeof(long long));
+
+		out.write(reinterpret_cast<const char*>(&symbolLength), sizeof(symbolLength));
+		out.write(symbol.data(), symbolLength);
+		out.write(entry.first.second.data(), 10);
+		out.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+		out.write(reinterpret_cast<const char*>(entry.second.timestamp.data()), bytes);
+		out.write(reinterpret_cast<const char*>(entry.second.volume.data()), bytes);
+	}
+
+	out.close();
+	if (!out.good())
+		return false;
+
+	std::error_code ec;
+	fs::rename(tmpFilename, filename, ec);
+	return !ec;
+}
+
+
+static bool readPartitionVolumes(const fs::path& filename, _VOLUME_SEGMENT& segment)
+{
+	vector<pair<long long, long long>> rows;
+	if (!readPartitionFile(filename, [&rows](const _BAR& bar) { rows.emplace_back(bar.timestamp, bar.volume); }))
+		return false;
+
+	std::stable_sort(rows.begin(), rows.end(), [](const pair<long long, long long>& a, const pair<long long, long long>& b) { return a.first < b.first; });
+
+	segment.timestamp.clear();
+	segment.volume.clear();
+	for (size_t i = 0; i < rows.size(); ++i)
+	{
+		// a later duplicate wins, as in BarStore::append()
+		if (i + 1 < rows.size() && rows[i + 1].first == rows[i].first)
+			continue;
+		segment.timestamp.push_back(rows[i].first);
+		segment.volume.push_back(rows[i].second);
+	}
+
+	return true;
+}
+
+
+bool updateVolumeIndex(const string& basePath)
+{
+	std::error_code ec;
+	const fs::path dailyRoot = fs::path(basePath) / "Daily";
+	if (!fs::exists(dailyRoot, ec))
+		return true;
+
+	// only the segment keys are read up front, the rows are loaded once a partition is known to have changed
+	const fs::path filename = volumeIndexFilename(basePath);
+	VolumeSegmentMap segments;
+	fs::file_time_type indexTime = fs::file_time_type::min();
+
+	if (fs::exists(filename, ec))
+	{
+		if (readSegments(filename, segments, true))
+			indexTime = fs::last_write_time(filename, ec);
+		else
+		{
+			LOG_WARNING << filename.string() << " is damaged, rebuilding it";
+			segments.clear();
+		}
+	}
+
+	// the index is stamped with the time the walk started, so a partition written meanwhile is read next time
+	const fs::file_time_type walkStarted = fs::file_time_type::clock::now();
+
+	set<pair<string, string>> present;
+	vector<pair<pair<string, string>, fs::path>> changed;
+	string symbol, date;
+
+	for (fs::recursive_directory_iterator itr(dailyRoot, ec), end; !ec && itr != end; itr.increment(ec))
+	{
+		if (!itr->is_regular_file(ec) || itr->path().extension() != ".csv")
+			continue;
+
+		if (!splitPartitionStem(itr->path().stem().string(), symbol, date) || date.size() != 10)
+			continue;
+
+		auto key = make_pair(symbol, date);
+		present.insert(key);
+
+		if (itr->last_write_time(ec) < indexTime && segments.count(key) > 0)
+			continue;
+
+		changed.emplace_back(key, itr->path());
+	}
+
+	size_t removed = 0;
+	for (const auto& segment : segments)
+		removed += present.count(segment.first) == 0 ? 1 : 0;
+
+	if (changed.empty() && removed == 0 && indexTime != fs::file_time_type::min())
+		return true;
+
+	if (indexTime != fs::file_time_type::min())
+	{
+		segments.clear();
+		if (!readSegments(filename, segments))
+		{
+			LOG_WARNING << filename.string() << " is damaged, rebuilding it";
+			return fs::remove(filename, ec) && updateVolumeIndex(basePath);
+		}
+	}
+
+	bool lOK = true;
+	size_t added = 0;
+	for (const auto& partition : changed)
+	{
+		_VOLUME_SEGMENT segment;
+		if (!readPartitionVolumes(partition.second, segment))
+		{
+			lOK = false;
+			continue;
+		}
+
+		segments[partition.first] = std::move(segment);
+		++added;
+	}
+
+	for (auto itr = segments.begin(); itr != segments.end();)
+	{
+		if (present.count(itr->first) == 0)
+			itr = segments.erase(itr);
+		else
+			++itr;
+	}
+
+	if (!writeSegments(filename, segments))
+	{
+		LOG_ERROR << "Cannot write " << filename.string();
+		return false;
+	}
+
+	fs::last_write_time(filename, walkStarted, ec);
+
+	LOG_INFO << "Volume index " << filename.string() << ": " << added << " partition(s) added, " << removed << " removed, "
+		<< segments.size() << " in total";
+	return lOK;
+}
+
+
+bool VolumeIndex::load(const string& basePath)
+{
+	std::error_code ec;
+	const fs::path filename = volumeIndexFilename(basePath);
+	const fs::file_time_type written = fs::last_write_time(filename, ec);
+
+	VolumeSegmentMap segments;
+	if (ec || !readSegments(filename, segments))
+		return false;
+
+	names.clear();
+	series.clear();
+	index.clear();
+	storeVersion = 0;
+
+	vector<long long> timestamp;
+	vector<long long> volume;
+
+	for (auto itr = segments.begin(); itr != segments.end();)
+	{
+		const string symbol = itr->first.first;
+		timestamp.clear();
+		volume.clear();
+
+		for (; itr != segments.end() && itr->first.first == symbol; ++itr)
+		{
+			timestamp.insert(timestamp.end(), itr->second.timestamp.begin(), itr->second.timestamp.end());
+			volume.insert(volume.end(), itr->second.volume.begin(), itr->second.volume.end());
+		}
+
+		add(symbol, timestamp, volume);
+	}
+
+	loadedPath = basePath;
+	loadedTime = written;
+	return true;
+}
+
+
+bool VolumeIndex::refresh(const string& basePath)
+{
+	std::error_code ec;
+	const fs::file_time_type written = fs::last_write_time(volumeIndexFilename(basePath), ec);
+	if (!ec && basePath == loadedPath && written == loadedTime)
+		return true;
+
+	return load(basePath);
+}
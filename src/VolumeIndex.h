@@ -0,0 +1,81 @@
+#pragma once
+#include <string>
+#include <filesystem>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "BarStore.h"
+
+// ------------------------------------------------------------------------------------------------------------------------------------
+// Cumulative volume per symbol, so the volume between any two times is one subtraction:
+//
+//   volume[from, to) = cumulative[row(to)] - cumulative[row(from)]
+//
+// row(t), the first bar at or after t, comes from a per-day directory of first rows followed by a
+// search inside that one day (at most 1440 bars), so a lookup costs the same for a week or ten years
+// of history. Top-N over a range evaluates every symbol that way and keeps the N largest with a
+// partial selection instead of sorting them all.
+//
+// The (timestamp, volume) rows of every Daily partition are kept in Daily/volume.index, one binary
+// segment per symbol-day, so /Top loads the index instead of parsing the CSV partitions. Compaction
+// brings the file up to date after every download, reading only the partitions written since.
+// ------------------------------------------------------------------------------------------------------------------------------------
+
+struct _VOLUME_SERIES
+{
+	std::vector<long long> timestamp;		// bar times, ascending
+	std::vector<long long> cumulative;		// volume of rows [0, i), one more entry than rows
+	long long firstDay = 0;					// days since the epoch of the first bar
+	std::vector<uint32_t> dayStart;			// first row on or after firstDay + d, one more entry than days
+
+	void build(const _BAR_SERIES& series);
+	void build(const std::vector<long long>& timestamp, const std::vector<long long>& volume);
+
+	// first row at or after <epoch>
+	size_t rowAt(long long epoch) const;
+
+	// shares traded in [from, to)
+	long long volume(long long from, long long to) const;
+};
+
+using SymbolVolume = std::pair<std::string, long long>;
+using SymbolVolumeVector = std::vector<SymbolVolume>;
+
+class VolumeIndex
+{
+public:
+	// indexes every series of <store>
+	void build(const BarStore& store);
+
+	// every symbol of the volume.index under <basePath>, see updateVolumeIndex()
+	bool load(const std::string& basePath);
+
+	// load(), unless the volume.index under <basePath> was not written since it was last loaded
+	bool refresh(const std::string& basePath);
+
+	// (re)indexes one symbol, e.g. after its bars were appended
+	void add(const std::string& symbol, const _BAR_SERIES& series);
+	void add(const std::string& symbol, const std::vector<long long>& timestamp, const std::vector<long long>& volume);
+
+	// shares of <symbol> traded in [from, to), UTC epoch seconds
+	long long volume(const std::string& symbol, long long from, long long to) const;
+
+	// the <n> symbols with the most volume in [from, to), largest first; symbols without volume are left out
+	SymbolVolumeVector top(long long from, long long to, size_t n) const;
+
+	size_t symbols() const { return names.size(); }
+	uint64_t version() const { return storeVersion; }
+
+private:
+	std::vector<std::string> names;
+	std::vector<_VOLUME_SERIES> series;
+	std::unordered_map<std::string, size_t> index;
+	uint64_t storeVersion = 0;
+	std::string loadedPath;
+	std::filesystem::file_time_type loadedTime = std::filesystem::file_time_type::min();
+};
+
+// folds the Daily partitions under <basePath> written since the last update into <basePath>/Daily/volume.index
+// and drops the ones that were removed
+bool updateVolumeIndex(const std::string& basePath);